@@ -0,0 +1,95 @@
+QT-=gui
+QT+=network
+
+TARGET=appcontroller
+# Next to the subprojects, where the tests and benchmarks find it
+DESTDIR=$$OUT_PWD/..
+
+HEADERS=\
+        ../process.h \
+        ../portlist.h \
+        ../perfprocesshandler.h \
+        ../outputforwarder.h \
+        ../perfcompressor.h \
+        ../controlprotocol.h \
+        ../daemon.h \
+        ../processtree.h \
+        ../launchtrace.h \
+        ../outputpipeline.h \
+        ../interactiveenvironment.h \
+        ../portallocator.h \
+        ../portleases.h \
+        ../signalnotifier.h \
+        ../appslot.h \
+        ../framedoutput.h \
+        ../linetimestamper.h \
+        ../logserver.h \
+        ../resourcesampler.h \
+        ../cgroup.h \
+        ../launchpolicy.h \
+        ../elffile.h \
+        ../pagecachewarmup.h \
+        ../elfpreflight.h \
+        ../perfsnapshotsender.h \
+        ../perfspool.h \
+        ../perfeventsampler.h \
+        ../gdbmultiserver.h
+
+SOURCES=\
+        ../main.cpp \
+        ../process.cpp \
+        ../portlist.cpp \
+        ../perfprocesshandler.cpp \
+        ../outputforwarder.cpp \
+        ../perfcompressor.cpp \
+        ../controlprotocol.cpp \
+        ../daemon.cpp \
+        ../processtree.cpp \
+        ../launchtrace.cpp \
+        ../outputpipeline.cpp \
+        ../interactiveenvironment.cpp \
+        ../portallocator.cpp \
+        ../portleases.cpp \
+        ../signalnotifier.cpp \
+        ../appslot.cpp \
+        ../framedoutput.cpp \
+        ../linetimestamper.cpp \
+        ../logserver.cpp \
+        ../resourcesampler.cpp \
+        ../cgroup.cpp \
+        ../launchpolicy.cpp \
+        ../elffile.cpp \
+        ../pagecachewarmup.cpp \
+        ../elfpreflight.cpp \
+        ../perfsnapshotsender.cpp \
+        ../perfspool.cpp \
+        ../perfeventsampler.cpp \
+        ../gdbmultiserver.cpp
+
+android {
+    target.path = $$[INSTALL_ROOT]/system/bin
+} else {
+    target.path = $$[INSTALL_ROOT]/usr/bin
+}
+INSTALLS+=target
+
+# Find out git hash
+exists($$PWD/../.git) {
+    unix:system(which git):HAS_GIT=TRUE
+    win32:system(where git.exe):HAS_GIT=TRUE
+    contains(HAS_GIT, TRUE) {
+        GIT_HASH=$$system(git -C $$PWD/.. log -1 --format=%H)
+        !system(git -C $$PWD/.. diff-index --quiet HEAD): GIT_HASH="$$GIT_HASH-dirty"
+        GIT_VERSION=$$system(git -C $$PWD/.. describe --tags --exact-match)
+        isEmpty(GIT_VERSION) : GIT_VERSION="unknown"
+    }
+} else {
+    GIT_HASH="unknown"
+    GIT_VERSION="unknown"
+}
+
+isEmpty(GIT_VERSION) : error("No suitable tag found")
+isEmpty(GIT_HASH) : error("No hash available")
+
+DEFINES+="GIT_HASH=\\\"$$GIT_HASH\\\""
+DEFINES+="GIT_VERSION=\\\"$$GIT_VERSION\\\""
@@ -0,0 +1,277 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "appslot.h"
+#include "daemon.h"
+#include <QSocketNotifier>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+
+AppSlot::AppSlot(Daemon *daemon, const QString &name, int serverSocket, const Config &config)
+    : QObject(daemon)
+    , mDaemon(daemon)
+    , mName(name)
+    , mServerSocket(serverSocket)
+    , mServerNotifier(0)
+    , mOwner(0)
+    , mPending(0)
+    , mClosing(false)
+{
+    mProcess.setConfig(config);
+    mProcess.setResident(true);
+    connect(&mProcess, &Process::exited, this, &AppSlot::processExited);
+
+    mServerNotifier = new QSocketNotifier(mServerSocket, QSocketNotifier::Read, this);
+    connect(mServerNotifier, &QSocketNotifier::activated, this, &AppSlot::incomingConnection);
+}
+
+AppSlot::~AppSlot()
+{
+    foreach (Client *client, mClients.values())
+        closeClient(client);
+    closeOutputFds();
+    foreach (int fd, mPendingFds)
+        ::close(fd);
+    if (mServerSocket >= 0)
+        ::close(mServerSocket);
+}
+
+QString AppSlot::name() const
+{
+    return mName;
+}
+
+void AppSlot::incomingConnection(int serverSocket)
+{
+    const int fd = accept4(serverSocket, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        perror("Could not accept connection");
+        return;
+    }
+    // LAUNCH runs any binary as our user, which usually is root
+    if (!ControlProtocol::isTrustedPeer(fd)) {
+        printf("AppController: Refused control connection from another user\n");
+        fflush(stdout);
+        ControlProtocol::sendReply(fd, "ERROR Permission denied");
+        ::close(fd);
+        return;
+    }
+
+    Client *client = new Client;
+    client->fd = fd;
+    client->notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(client->notifier, &QSocketNotifier::activated, this, &AppSlot::readCommand);
+    mClients.insert(fd, client);
+}
+
+void AppSlot::readCommand(int fd)
+{
+    Client *client = mClients.value(fd);
+    if (!client)
+        return;
+
+    const bool hadCommand = !client->reader.command().isEmpty();
+    switch (client->reader.readFrom(fd)) {
+    case CommandReader::Incomplete:
+        return;
+    case CommandReader::Complete:
+        if (!hadCommand) {
+            execute(client);
+            return;
+        }
+        // Only one command per connection
+        // fall through
+    case CommandReader::Error:
+        if (!hadCommand)
+            ControlProtocol::sendReply(fd, "ERROR Malformed command");
+        break;
+    case CommandReader::Closed:
+        if (!hadCommand) {
+            // An older appcontroller wants to take over
+            closeClient(client);
+            mDaemon->exitRequested(this);
+            return;
+        }
+        break;
+    }
+
+    if (client == mPending) {
+        mPending = 0;
+        foreach (int pendingFd, mPendingFds)
+            ::close(pendingFd);
+        mPendingFds.clear();
+    }
+    if (client == mOwner && mProcess.isRunning())
+        mProcess.stop();
+    if (mClients.contains(fd))
+        closeClient(client);
+}
+
+void AppSlot::execute(Client *client)
+{
+    const QByteArray command = client->reader.command();
+    const QStringList args = client->reader.arguments();
+    const QVector<int> fds = client->reader.takeFds();
+
+    if (mClosing) {
+        foreach (int fd, fds)
+            ::close(fd);
+        ControlProtocol::sendReply(client->fd, "ERROR Slot is shutting down");
+        closeClient(client);
+    } else if (command == "LAUNCH" && !args.isEmpty()) {
+        if (mProcess.isRunning() || mPending) {
+            // The running application is replaced, the new one starts once it has exited
+            if (mPending) {
+                ControlProtocol::sendReply(mPending->fd, "ERROR Replaced by another launch request");
+                closeClient(mPending);
+                foreach (int fd, mPendingFds)
+                    ::close(fd);
+            }
+            mPending = client;
+            mPendingArgs = args;
+            mPendingFds = fds;
+            if (mProcess.isRunning())
+                mProcess.stop();
+            return;
+        }
+        launch(client, args, fds);
+    } else if (command == "EXIT") {
+        foreach (int fd, fds)
+            ::close(fd);
+        ControlProtocol::sendReply(client->fd, "STOPPING");
+        const int fd = fcntl(client->fd, F_DUPFD_CLOEXEC, 0);
+        if (fd >= 0)
+            mTakeoverFds.append(fd);
+        closeClient(client);
+        mDaemon->exitRequested(this);
+    } else if (command == "SLOT" && args.size() == 1) {
+        foreach (int fd, fds)
+            ::close(fd);
+        QByteArray error;
+        if (mDaemon->openSlot(args.first(), &error))
+            ControlProtocol::sendReply(client->fd, "OK");
+        else
+            ControlProtocol::sendReply(client->fd, "ERROR " + error);
+        closeClient(client);
+    } else if (command == "PIDS") {
+        foreach (int fd, fds)
+            ::close(fd);
+        mProcess.replyApplicationPids(client->fd);
+        closeClient(client);
+    } else if (command == "STOP") {
+        foreach (int fd, fds)
+            ::close(fd);
+        if (mProcess.isRunning())
+            mProcess.stop();
+        ControlProtocol::sendReply(client->fd, "OK");
+        closeClient(client);
+    } else {
+        foreach (int fd, fds)
+            ::close(fd);
+        ControlProtocol::sendReply(client->fd, "ERROR Unknown command " + command);
+        closeClient(client);
+    }
+}
+
+void AppSlot::launch(Client *client, const QStringList &args, const QVector<int> &fds)
+{
+    mOwner = client;
+    mOutputFds = fds;
+    mProcess.setStdoutFd(fds.size() > 0 ? fds.at(0) : STDOUT_FILENO);
+    mProcess.setStderrFd(fds.size() > 1 ? fds.at(1) : STDERR_FILENO);
+    ControlProtocol::sendReply(client->fd, "STARTED");
+    mProcess.start(args);
+}
+
+void AppSlot::processExited(int exitCode)
+{
+    if (mOwner) {
+        ControlProtocol::sendReply(mOwner->fd, "EXITED " + QByteArray::number(exitCode));
+        closeClient(mOwner);
+    }
+    closeOutputFds();
+
+    if (mClosing) {
+        finishClose();
+        return;
+    }
+
+    if (mPending) {
+        Client *client = mPending;
+        const QVector<int> fds = mPendingFds;
+        mPending = 0;
+        mPendingFds.clear();
+        launch(client, mPendingArgs, fds);
+    }
+}
+
+void AppSlot::closeClient(Client *client)
+{
+    if (client == mOwner)
+        mOwner = 0;
+    if (client == mPending)
+        mPending = 0;
+    mClients.remove(client->fd);
+    client->notifier->setEnabled(false);
+    client->notifier->deleteLater();
+    ::close(client->fd);
+    delete client;
+}
+
+void AppSlot::closeOutputFds()
+{
+    foreach (int fd, mOutputFds)
+        ::close(fd);
+    mOutputFds.clear();
+}
+
+void AppSlot::close()
+{
+    if (mClosing)
+        return;
+    mClosing = true;
+
+    if (mPending) {
+        ControlProtocol::sendReply(mPending->fd, "ERROR Slot is shutting down");
+        closeClient(mPending);
+        foreach (int fd, mPendingFds)
+            ::close(fd);
+        mPendingFds.clear();
+    }
+    if (mProcess.isRunning())
+        mProcess.stop();
+    else
+        finishClose();
+}
+
+void AppSlot::finishClose()
+{
+    if (mServerSocket >= 0) {
+        mServerNotifier->setEnabled(false);
+        ::close(mServerSocket);
+        mServerSocket = -1;
+    }
+    foreach (int fd, mTakeoverFds) {
+        ControlProtocol::sendReply(fd, "STOPPED");
+        ::close(fd);
+    }
+    mTakeoverFds.clear();
+    mDaemon->slotClosed(this);
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef APPSLOT_H
+#define APPSLOT_H
+
+#include "process.h"
+#include "controlprotocol.h"
+#include <QHash>
+
+class QSocketNotifier;
+class Daemon;
+
+// One application supervised by the daemon, with its own control socket, output
+// routing and exit handling. See daemon.h for the commands.
+class AppSlot : public QObject
+{
+    Q_OBJECT
+public:
+    AppSlot(Daemon *daemon, const QString &name, int serverSocket, const Config &config);
+    ~AppSlot();
+
+    QString name() const;
+
+    // Stops the application and releases the control socket, then reports to the daemon
+    void close();
+
+private slots:
+    void incomingConnection(int serverSocket);
+    void readCommand(int fd);
+    void processExited(int exitCode);
+
+private:
+    struct Client {
+        int fd;
+        QSocketNotifier *notifier;
+        CommandReader reader;
+    };
+
+    void execute(Client *client);
+    void launch(Client *client, const QStringList &args, const QVector<int> &fds);
+    void closeClient(Client *client);
+    void closeOutputFds();
+    void finishClose();
+
+    Daemon *mDaemon;
+    QString mName;
+    int mServerSocket;
+    QSocketNotifier *mServerNotifier;
+    Process mProcess;
+    QHash<int, Client *> mClients;
+    Client *mOwner;
+    QVector<int> mOutputFds;
+    Client *mPending;
+    QStringList mPendingArgs;
+    QVector<int> mPendingFds;
+    QVector<int> mTakeoverFds;
+    bool mClosing;
+};
+
+#endif // APPSLOT_H
@@ -0,0 +1,18 @@
+QT-=gui
+QT+=network testlib
+CONFIG+=console testcase no_testcase_installs
+CONFIG-=app_bundle
+
+TARGET=tst_bench_appcontroller
+INCLUDEPATH+=..
+
+HEADERS=\
+        ../portlist.h
+
+SOURCES=\
+        tst_bench_appcontroller.cpp \
+        ../portlist.cpp
+
+# The end-to-end benchmarks run the controller built next to this directory,
+# APPCONTROLLER_BINARY in the environment overrides it.
+DEFINES+="APPCONTROLLER_DEFAULT_BINARY=\\\"$$OUT_PWD/../appcontroller\\\""
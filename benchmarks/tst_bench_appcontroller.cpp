@@ -0,0 +1,325 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+// Benchmarks for the hot paths of the controller. The end-to-end benchmarks run the
+// appcontroller binary and stop any application it is currently running on the device.
+
+#include "portlist.h"
+#include <QtTest>
+#include <QProcess>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QThread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+static const int ForwardedBytes = 64 * 1024 * 1024;
+static const int ForwardingIterations = 3;
+static const int RelaunchIterations = 10;
+static const int Timeout = 30000; // ms
+
+class tst_BenchAppController : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void portListFromString();
+    void portListGetNext();
+    void portListContains();
+
+    void forwardingThroughput_data();
+    void forwardingThroughput();
+    void launchLatency();
+    void relaunchLatency();
+
+private:
+    void requireBinary();
+    void forwardThroughController(const QStringList &command, bool toPipe);
+    void forwardThroughQProcess(const QStringList &command, bool toPipe);
+    QString mBinary;
+    QString mPortSpec;
+};
+
+static bool waitForLine(QProcess *process, const QByteArray &line)
+{
+    QByteArray output;
+    while (!output.contains(line)) {
+        if (!process->waitForReadyRead(Timeout))
+            return false;
+        output += process->readAllStandardOutput();
+    }
+    return true;
+}
+
+// Reads a pipe until all writers have closed it, like a host receiving the output
+class PipeDrain : public QThread
+{
+public:
+    explicit PipeDrain(int fd) : mFd(fd), mReceived(0) { }
+    qint64 received() const { return mReceived; }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        char buffer[64 * 1024];
+        forever {
+            const ssize_t size = read(mFd, buffer, sizeof(buffer));
+            if (size < 0 && errno == EINTR)
+                continue;
+            if (size <= 0)
+                break;
+            mReceived += size;
+        }
+    }
+
+private:
+    int mFd;
+    qint64 mReceived;
+};
+
+static bool writeAll(int fd, const char *data, qint64 size)
+{
+    while (size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+void tst_BenchAppController::initTestCase()
+{
+    mBinary = QString::fromLocal8Bit(qgetenv("APPCONTROLLER_BINARY"));
+    if (mBinary.isEmpty())
+        mBinary = QLatin1String(APPCONTROLLER_DEFAULT_BINARY);
+
+    // 5000 ranges of 5 ports each, as produced by generous --port-range specifications
+    for (int i = 0; i < 5000; ++i) {
+        if (i > 0)
+            mPortSpec += QLatin1Char(',');
+        const int start = 1024 + i * 10;
+        mPortSpec += QString::number(start) + QLatin1Char('-') + QString::number(start + 4);
+    }
+}
+
+void tst_BenchAppController::requireBinary()
+{
+    if (!QFileInfo(mBinary).isExecutable())
+        QSKIP("appcontroller binary not found, set APPCONTROLLER_BINARY");
+}
+
+void tst_BenchAppController::portListFromString()
+{
+    QBENCHMARK {
+        Utils::PortList list = Utils::PortList::fromString(mPortSpec);
+        QVERIFY(list.hasMore());
+    }
+}
+
+void tst_BenchAppController::portListGetNext()
+{
+    const Utils::PortList list = Utils::PortList::fromString(mPortSpec);
+    QCOMPARE(list.count(), 25000);
+
+    QBENCHMARK {
+        Utils::PortList copy = list;
+        int count = 0;
+        while (copy.hasMore()) {
+            copy.getNext();
+            ++count;
+        }
+        QCOMPARE(count, 25000);
+    }
+}
+
+void tst_BenchAppController::portListContains()
+{
+    const Utils::PortList list = Utils::PortList::fromString(mPortSpec);
+
+    QBENCHMARK {
+        int found = 0;
+        for (int port = 1024; port < 51024; port += 7) {
+            if (list.contains(port))
+                ++found;
+        }
+        QVERIFY(found > 0);
+    }
+}
+
+void tst_BenchAppController::forwardingThroughput_data()
+{
+    QTest::addColumn<bool>("approximation");
+    QTest::addColumn<bool>("toPipe");
+
+    QTest::newRow("devnull") << false << false;
+    QTest::newRow("pipe") << false << true;
+    // Only an approximation of the controller before splicing: the same QProcess read and
+    // write() copies, but in this process, without the old controller's event loop and
+    // select(). Compare releases of the controller through the rows above.
+    QTest::newRow("qprocess-approximation-devnull") << true << false;
+    QTest::newRow("qprocess-approximation-pipe") << true << true;
+}
+
+// Reports bytes per second, so that the rows and releases can be compared directly
+void tst_BenchAppController::forwardingThroughput()
+{
+    QFETCH(bool, approximation);
+    QFETCH(bool, toPipe);
+    if (!approximation)
+        requireBinary();
+
+    QStringList command;
+    command << QLatin1String("/bin/sh") << QLatin1String("-c")
+            << QString::fromLatin1("head -c %1 /dev/zero").arg(ForwardedBytes);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < ForwardingIterations; ++i) {
+        if (approximation)
+            forwardThroughQProcess(command, toPipe);
+        else
+            forwardThroughController(command, toPipe);
+        if (QTest::currentTestFailed())
+            return;
+    }
+
+    const qreal seconds = timer.nsecsElapsed() / 1000000000.0;
+    QTest::setBenchmarkResult(qreal(ForwardedBytes) * ForwardingIterations / seconds,
+                              QTest::BytesPerSecond);
+}
+
+void tst_BenchAppController::forwardThroughController(const QStringList &command, bool toPipe)
+{
+    QStringList args;
+    args << QLatin1String("--launch") << command;
+
+    QProcess controller;
+    if (!toPipe)
+        controller.setStandardOutputFile(QProcess::nullDevice());
+    controller.start(mBinary, args);
+    QVERIFY(controller.waitForStarted(Timeout));
+
+    if (toPipe) {
+        qint64 received = 0;
+        while (controller.waitForReadyRead(Timeout))
+            received += controller.readAllStandardOutput().size();
+        received += controller.readAllStandardOutput().size();
+        QVERIFY(received >= ForwardedBytes);
+    }
+    QVERIFY(controller.waitForFinished(Timeout));
+}
+
+void tst_BenchAppController::forwardThroughQProcess(const QStringList &command, bool toPipe)
+{
+    int fd;
+    int fds[2] = { -1, -1 };
+    if (toPipe) {
+        QVERIFY(pipe(fds) == 0);
+        fd = fds[1];
+    } else {
+        fd = open("/dev/null", O_WRONLY);
+        QVERIFY(fd >= 0);
+    }
+    PipeDrain drain(fds[0]);
+    if (toPipe)
+        drain.start();
+
+    QProcess process;
+    bool ok = true;
+    qint64 forwarded = 0;
+    process.start(command.first(), command.mid(1));
+    while (ok && process.waitForReadyRead(Timeout)) {
+        const QByteArray data = process.readAllStandardOutput();
+        ok = writeAll(fd, data.constData(), data.size());
+        forwarded += data.size();
+    }
+    const bool finished = process.waitForFinished(Timeout);
+    const QByteArray rest = process.readAllStandardOutput();
+    ok = ok && writeAll(fd, rest.constData(), rest.size());
+    forwarded += rest.size();
+
+    close(fd);
+    if (toPipe) {
+        drain.wait();
+        close(fds[0]);
+    }
+    QVERIFY(finished);
+    QVERIFY(ok);
+    QCOMPARE(forwarded, qint64(ForwardedBytes));
+    if (toPipe)
+        QCOMPARE(drain.received(), qint64(ForwardedBytes));
+}
+
+void tst_BenchAppController::launchLatency()
+{
+    requireBinary();
+
+    QStringList args;
+    args << QLatin1String("--launch") << QLatin1String("/bin/true");
+
+    QBENCHMARK {
+        QProcess controller;
+        controller.setStandardOutputFile(QProcess::nullDevice());
+        controller.start(mBinary, args);
+        QVERIFY(controller.waitForFinished(Timeout));
+        QCOMPARE(controller.exitStatus(), QProcess::NormalExit);
+    }
+}
+
+void tst_BenchAppController::relaunchLatency()
+{
+    requireBinary();
+
+    QStringList runningArgs;
+    runningArgs << QLatin1String("/bin/sh") << QLatin1String("-c")
+                << QLatin1String("echo ready; exec sleep 60");
+    QStringList relaunchArgs;
+    relaunchArgs << QLatin1String("/bin/sh") << QLatin1String("-c") << QLatin1String("echo ready");
+
+    // Time from starting the new controller until its application runs, which includes
+    // stopping the old application and taking over the control socket.
+    qint64 total = 0;
+    for (int i = 0; i < RelaunchIterations; ++i) {
+        QProcess running;
+        running.start(mBinary, runningArgs);
+        QVERIFY(waitForLine(&running, "ready"));
+
+        QElapsedTimer timer;
+        timer.start();
+        QProcess relaunched;
+        relaunched.start(mBinary, relaunchArgs);
+        QVERIFY(waitForLine(&relaunched, "ready"));
+        total += timer.nsecsElapsed();
+
+        QVERIFY(running.waitForFinished(Timeout));
+        QVERIFY(relaunched.waitForFinished(Timeout));
+    }
+
+    QTest::setBenchmarkResult(total / RelaunchIterations / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+QTEST_GUILESS_MAIN(tst_BenchAppController)
+
+#include "tst_bench_appcontroller.moc"
@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "cgroup.h"
+#include <QFile>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char * const LimitFiles[] = {
+    "cpu.max", "cpu.weight", "memory.max", "memory.high", "io.weight", 0
+};
+
+static bool writeTo(const QByteArray &path, const QByteArray &value)
+{
+    const int fd = open(path.constData(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    const bool ok = write(fd, value.constData(), value.size()) == value.size();
+    const int error = errno;
+    close(fd);
+    errno = error;
+    return ok;
+}
+
+static QByteArray parentDirectory(const QByteArray &path)
+{
+    const int index = path.lastIndexOf('/');
+    return index > 0 ? path.left(index) : QByteArray();
+}
+
+Cgroup::Cgroup()
+    : mProcsFd(-1)
+{
+}
+
+Cgroup::~Cgroup()
+{
+    destroy();
+}
+
+bool Cgroup::isValidLimit(const QString &limit)
+{
+    const int index = limit.indexOf(QLatin1Char('='));
+    if (index <= 0)
+        return false;
+    const QString file = limit.left(index);
+    for (int i = 0; LimitFiles[i]; ++i) {
+        if (file == QLatin1String(LimitFiles[i]))
+            return true;
+    }
+    return false;
+}
+
+bool Cgroup::create(const QString &parent, const QStringList &limits)
+{
+    destroy();
+
+    // The controllers must be enabled for the children of every level above the group
+    const QByteArray parentPath = QFile::encodeName(parent);
+    if (mkdir(parentPath.constData(), 0755) != 0 && errno != EEXIST) {
+        printf("AppController: Could not create cgroup %s: %s\n", parentPath.constData(), strerror(errno));
+        return false;
+    }
+    const QByteArray controllers = "+cpu +memory +io";
+    const QByteArray grandParent = parentDirectory(parentPath);
+    if (!grandParent.isEmpty())
+        writeTo(grandParent + "/cgroup.subtree_control", controllers);
+    if (!writeTo(parentPath + "/cgroup.subtree_control", controllers)) {
+        printf("AppController: Could not enable cgroup controllers in %s: %s\n",
+               parentPath.constData(), strerror(errno));
+    }
+
+    static int launches = 0;
+    const QByteArray path = parentPath + "/app-" + QByteArray::number(getpid())
+            + '-' + QByteArray::number(++launches);
+    if (mkdir(path.constData(), 0755) != 0) {
+        printf("AppController: Could not create cgroup %s: %s\n", path.constData(), strerror(errno));
+        return false;
+    }
+    mPath = path;
+
+    foreach (const QString &limit, limits) {
+        const int index = limit.indexOf(QLatin1Char('='));
+        const QByteArray file = limit.left(index).toLatin1();
+        const QByteArray value = limit.mid(index + 1).toLatin1();
+        if (!writeFile(file.constData(), value)) {
+            printf("AppController: Could not set %s to %s: %s\n",
+                   file.constData(), value.constData(), strerror(errno));
+        }
+    }
+
+    mProcsFd = open((mPath + "/cgroup.procs").constData(), O_WRONLY | O_CLOEXEC);
+    if (mProcsFd < 0) {
+        printf("AppController: Could not open %s/cgroup.procs: %s\n", mPath.constData(), strerror(errno));
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+bool Cgroup::isValid() const
+{
+    return mProcsFd >= 0;
+}
+
+void Cgroup::joinFromChild() const
+{
+    // "0" stands for the writing process
+    if (mProcsFd >= 0 && write(mProcsFd, "0", 1) != 1) {
+        static const char message[] = "AppController: Could not join cgroup\n";
+        // Nothing left to do if stderr fails as well
+        if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0) { }
+    }
+}
+
+bool Cgroup::kill() const
+{
+    return !mPath.isEmpty() && writeFile("cgroup.kill", "1");
+}
+
+void Cgroup::printReport() const
+{
+    if (mPath.isEmpty())
+        return;
+
+    printf("AppController: cgroup %s\n", mPath.constData());
+    const char * const files[] = { "cpu.pressure", "memory.pressure", "io.pressure" };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        const QByteArray content = readFile(files[i]).trimmed();
+        if (content.isEmpty())
+            continue;
+        foreach (const QByteArray &line, content.split('\n'))
+            printf("  %s %s\n", files[i], line.constData());
+    }
+
+    const QByteArray events = readFile("memory.events").simplified();
+    if (!events.isEmpty())
+        printf("  memory.events %s\n", events.constData());
+
+    // Only the throttling counters, the usage is covered by the resource sampler
+    foreach (const QByteArray &line, readFile("cpu.stat").split('\n')) {
+        if (line.startsWith("nr_throttled") || line.startsWith("throttled_usec"))
+            printf("  cpu.stat %s\n", line.constData());
+    }
+}
+
+void Cgroup::destroy()
+{
+    if (mProcsFd >= 0) {
+        close(mProcsFd);
+        mProcsFd = -1;
+    }
+    if (mPath.isEmpty())
+        return;
+    // Fails while processes are still in the group, which then stays behind
+    if (rmdir(mPath.constData()) != 0)
+        printf("AppController: Could not remove cgroup %s: %s\n", mPath.constData(), strerror(errno));
+    mPath.clear();
+}
+
+bool Cgroup::writeFile(const char *name, const QByteArray &value) const
+{
+    return writeTo(mPath + '/' + name, value);
+}
+
+QByteArray Cgroup::readFile(const char *name) const
+{
+    QFile file(QFile::decodeName(mPath + '/' + name));
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+// A cgroup v2 per launch, below a common parent group. The limits are written to the
+// interface files of the new group before the application starts, and the child moves
+// itself into the group between fork and exec, so that it never runs outside of it.
+// When the application has exited, the pressure stall information and the memory
+// events of the group are printed and the group is removed again.
+class Cgroup
+{
+public:
+    Cgroup();
+    ~Cgroup();
+
+    // limits are "<file>=<value>" for cpu.max, cpu.weight, memory.max, memory.high
+    // and io.weight
+    static bool isValidLimit(const QString &limit);
+
+    bool create(const QString &parent, const QStringList &limits);
+    bool isValid() const;
+
+    // Called in the child process after fork, only uses async-signal-safe functions
+    void joinFromChild() const;
+
+    // Kills everything still in the group, needs Linux 5.14
+    bool kill() const;
+
+    void printReport() const;
+    void destroy();
+
+private:
+    bool writeFile(const char *name, const QByteArray &value) const;
+    QByteArray readFile(const char *name) const;
+
+    QByteArray mPath;
+    int mProcsFd;
+};
+
+#endif // CGROUP_H
@@ -0,0 +1,281 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "controlprotocol.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static const char BaseSocketName[] = "#Boot2Qt_appcontroller";
+static const int MaxFds = 4;
+static const int MaxCommandSize = 256 * 1024;
+
+static bool writeAll(int fd, const char *data, int size)
+{
+    while (size > 0) {
+        const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+namespace ControlProtocol {
+
+QByteArray socketName(const QString &slot)
+{
+    QByteArray name = BaseSocketName;
+    if (!slot.isEmpty())
+        name += '.' + slot.toLatin1();
+    return name;
+}
+
+bool isValidSlotName(const QString &slot)
+{
+    if (slot.isEmpty() || slot.size() > 64)
+        return false;
+    foreach (const QChar c, slot) {
+        if (c.unicode() > 127 || !(c.isLetterOrNumber() || c == QLatin1Char('-') || c == QLatin1Char('_')))
+            return false;
+    }
+    return true;
+}
+
+void setupAddress(struct sockaddr_un *address, const QByteArray &name)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strncpy(address->sun_path, name.constData(), sizeof(address->sun_path) - 1);
+    if (name.startsWith('#'))
+        address->sun_path[0] = 0;
+}
+
+int connectSocket(const QByteArray &name)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un address;
+    setupAddress(&address, name);
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int listenSocket(const QByteArray &name)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_un address;
+    setupAddress(&address, name);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, 5) != 0) {
+        const int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+bool isTrustedPeer(int fd)
+{
+    struct ucred credentials;
+    socklen_t size = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0
+            || size != sizeof(credentials))
+        return false;
+    return credentials.uid == 0 || credentials.uid == geteuid();
+}
+
+bool sendCommand(int fd, const QByteArray &command, const QStringList &arguments,
+                 const QVector<int> &fds)
+{
+    Q_ASSERT(fds.size() <= MaxFds);
+
+    QByteArray message = command + ' ' + QByteArray::number(arguments.size()) + '\n';
+    foreach (const QString &argument, arguments) {
+        message += argument.toLocal8Bit();
+        message += '\0';
+    }
+
+    // The descriptors travel with the first byte, the rest is written normally
+    struct iovec iov;
+    iov.iov_base = message.data();
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(MaxFds * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (!fds.isEmpty()) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds.constData(), fds.size() * sizeof(int));
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != 1)
+        return false;
+
+    return writeAll(fd, message.constData() + 1, message.size() - 1);
+}
+
+bool sendReply(int fd, const QByteArray &reply)
+{
+    const QByteArray line = reply + '\n';
+    return writeAll(fd, line.constData(), line.size());
+}
+
+// Blocks until a complete line was received. Data following the line stays in buffer.
+bool readReply(int fd, QByteArray *buffer, QByteArray *reply)
+{
+    forever {
+        const int index = buffer->indexOf('\n');
+        if (index >= 0) {
+            *reply = buffer->left(index);
+            buffer->remove(0, index + 1);
+            return true;
+        }
+
+        char data[256];
+        const ssize_t size = read(fd, data, sizeof(data));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            return false;
+        buffer->append(data, size);
+    }
+}
+
+} // namespace ControlProtocol
+
+CommandReader::CommandReader()
+{
+}
+
+CommandReader::~CommandReader()
+{
+    foreach (int fd, mFds)
+        close(fd);
+}
+
+CommandReader::State CommandReader::readFrom(int fd)
+{
+    char data[4096];
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = sizeof(data);
+
+    char control[CMSG_SPACE(MaxFds * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const ssize_t size = recvmsg(fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (size < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? Incomplete : Error;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        const int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *fds = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        for (int i = 0; i < count; ++i)
+            mFds.append(fds[i]);
+    }
+
+    if (size == 0)
+        return mBuffer.isEmpty() && mCommand.isEmpty() ? Closed : Error;
+
+    mBuffer.append(data, size);
+    if (mBuffer.size() > MaxCommandSize)
+        return Error;
+    return parse();
+}
+
+CommandReader::State CommandReader::parse()
+{
+    const int headerEnd = mBuffer.indexOf('\n');
+    if (headerEnd < 0)
+        return Incomplete;
+
+    const QList<QByteArray> header = mBuffer.left(headerEnd).split(' ');
+    bool ok = false;
+    const int count = header.size() == 2 ? header.at(1).toInt(&ok) : -1;
+    if (!ok || count < 0)
+        return Error;
+
+    QStringList arguments;
+    int pos = headerEnd + 1;
+    for (int i = 0; i < count; ++i) {
+        const int end = mBuffer.indexOf('\0', pos);
+        if (end < 0)
+            return Incomplete;
+        arguments.append(QString::fromLocal8Bit(mBuffer.constData() + pos, end - pos));
+        pos = end + 1;
+    }
+
+    mCommand = header.at(0);
+    mArguments = arguments;
+    mBuffer.remove(0, pos);
+    return Complete;
+}
+
+QByteArray CommandReader::command() const
+{
+    return mCommand;
+}
+
+QStringList CommandReader::arguments() const
+{
+    return mArguments;
+}
+
+QVector<int> CommandReader::takeFds()
+{
+    QVector<int> fds = mFds;
+    mFds.clear();
+    return fds;
+}
@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef CONTROLPROTOCOL_H
+#define CONTROLPROTOCOL_H
+
+#include <QByteArray>
+#include <QStringList>
+#include <QVector>
+
+struct sockaddr_un;
+
+// Commands sent over the abstract control socket consist of a header line
+// "<command> <argument count>\n" followed by the arguments, each terminated by '\0'.
+// File descriptors are passed as SCM_RIGHTS together with the header.
+// Replies are single lines. "EXIT" asks the running instance to stop its application
+// and to exit; it replies "STOPPING" right away and "STOPPED" once the application has
+// exited and the control socket has been released. A connection that is closed without
+// sending anything has the same effect, without the replies. "PIDS" asks for the processes
+// of the running application; the reply is "PIDS <pid>[,<pid>...]", the debuggee and its
+// children when running under gdbserver, or "ERROR <message>".
+//
+// Named application slots have their own control socket, see socketName().
+namespace ControlProtocol {
+
+// "#Boot2Qt_appcontroller" for the default slot, "#Boot2Qt_appcontroller.<slot>" otherwise.
+// A leading '#' stands for the abstract namespace.
+QByteArray socketName(const QString &slot = QString());
+bool isValidSlotName(const QString &slot);
+void setupAddress(struct sockaddr_un *address, const QByteArray &name);
+int connectSocket(const QByteArray &name);
+int listenSocket(const QByteArray &name);
+// Whether the peer of a connected socket runs as our effective user or as root.
+// Abstract sockets have no file permissions, so anybody on the device can connect.
+bool isTrustedPeer(int fd);
+
+bool sendCommand(int fd, const QByteArray &command, const QStringList &arguments,
+                 const QVector<int> &fds = QVector<int>());
+bool sendReply(int fd, const QByteArray &reply);
+bool readReply(int fd, QByteArray *buffer, QByteArray *reply);
+
+} // namespace ControlProtocol
+
+class CommandReader
+{
+public:
+    enum State {
+        Incomplete,
+        Complete,
+        Closed,
+        Error
+    };
+
+    CommandReader();
+    ~CommandReader();
+
+    State readFrom(int fd);
+
+    QByteArray command() const;
+    QStringList arguments() const;
+    QVector<int> takeFds();
+
+private:
+    State parse();
+
+    QByteArray mBuffer;
+    QByteArray mCommand;
+    QStringList mArguments;
+    QVector<int> mFds;
+};
+
+#endif // CONTROLPROTOCOL_H
@@ -0,0 +1,109 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "daemon.h"
+#include "appslot.h"
+#include "controlprotocol.h"
+#include "signalnotifier.h"
+#include <QCoreApplication>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+Daemon::Daemon(int serverSocket, const Config &config)
+    : mConfig(config)
+    , mDefaultSlot(new AppSlot(this, QString(), serverSocket, config))
+    , mShuttingDown(false)
+{
+    // A LAUNCH client closing its output must not take down the other slots
+    SignalNotifier::instance()->ignoreBrokenPipe();
+    connect(SignalNotifier::instance(), &SignalNotifier::received, this, &Daemon::shutdown);
+
+    printf("AppController: Daemon waiting for launch requests\n");
+    fflush(stdout);
+}
+
+Daemon::~Daemon()
+{
+    qDeleteAll(mSlots);
+    delete mDefaultSlot;
+}
+
+bool Daemon::openSlot(const QString &name, QByteArray *error)
+{
+    if (!ControlProtocol::isValidSlotName(name)) {
+        *error = "Invalid slot name";
+        return false;
+    }
+    if (mShuttingDown) {
+        *error = "Daemon is shutting down";
+        return false;
+    }
+    if (mSlots.contains(name))
+        return true;
+
+    const int serverSocket = ControlProtocol::listenSocket(ControlProtocol::socketName(name));
+    if (serverSocket < 0) {
+        *error = "Could not open slot socket: " + QByteArray(strerror(errno));
+        return false;
+    }
+
+    mSlots.insert(name, new AppSlot(this, name, serverSocket, mConfig));
+    printf("AppController: Opened slot %s\n", qPrintable(name));
+    fflush(stdout);
+    return true;
+}
+
+void Daemon::exitRequested(AppSlot *slot)
+{
+    if (slot == mDefaultSlot)
+        shutdown();
+    else
+        slot->close();
+}
+
+void Daemon::slotClosed(AppSlot *slot)
+{
+    if (slot == mDefaultSlot) {
+        qApp->quit();
+        return;
+    }
+
+    printf("AppController: Closed slot %s\n", qPrintable(slot->name()));
+    fflush(stdout);
+    mSlots.remove(slot->name());
+    slot->deleteLater();
+
+    // The default slot owns the regular control socket, so it goes last
+    if (mShuttingDown && mSlots.isEmpty())
+        mDefaultSlot->close();
+}
+
+void Daemon::shutdown()
+{
+    if (mShuttingDown)
+        return;
+    mShuttingDown = true;
+
+    if (mSlots.isEmpty()) {
+        mDefaultSlot->close();
+        return;
+    }
+    foreach (AppSlot *slot, mSlots.values())
+        slot->close();
+}
@@ -0,0 +1,66 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "process.h"
+#include <QHash>
+
+class AppSlot;
+
+// Stays resident on the control socket and launches applications on request, reusing
+// the configuration and environment of the first launch for all following ones.
+// Applications run in slots that are supervised independently by the same event loop.
+// The default slot uses the regular control socket, named slots are opened on request
+// and get their own socket, see ControlProtocol::socketName(). Only connections from
+// the daemon's own user and from root are accepted on any of the slot sockets.
+//
+// Commands (see controlprotocol.h), sent to the socket of a slot:
+//   LAUNCH <binary> [arguments]  with stdout and stderr of the client as descriptors.
+//                                Replies "STARTED" and "EXITED <exit code>" when done.
+//                                Closing the connection stops the application.
+//   STOP                         Stops the running application, replies "OK".
+//   PIDS                         Replies "PIDS <pid>[,<pid>...]" with the processes of the
+//                                running application, for attaching a profiler.
+//   SLOT <name>                  Opens the named slot unless it exists, replies "OK".
+//   EXIT                         Stops the application and closes the slot. On the
+//                                default slot all slots are closed and the daemon
+//                                ends, so that a regular appcontroller can take over.
+class Daemon : public QObject
+{
+    Q_OBJECT
+public:
+    Daemon(int serverSocket, const Config &config);
+    ~Daemon();
+
+    bool openSlot(const QString &name, QByteArray *error);
+    void exitRequested(AppSlot *slot);
+    void slotClosed(AppSlot *slot);
+
+private slots:
+    void shutdown();
+
+private:
+    Config mConfig;
+    AppSlot *mDefaultSlot;
+    QHash<QString, AppSlot *> mSlots;
+    bool mShuttingDown;
+};
+
+#endif // DAEMON_H
@@ -0,0 +1,354 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "elffile.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSet>
+#include <QVector>
+#include <QtEndian>
+#include <elf.h>
+#include <stddef.h>
+#include <string.h>
+
+// Offset and size of a header field, for the class (is64) of the file being read
+#define ELF_FIELD(type, member) \
+    (is64 ? offsetof(Elf64_##type, member) : offsetof(Elf32_##type, member)), \
+    (is64 ? sizeof(((Elf64_##type *)0)->member) : sizeof(((Elf32_##type *)0)->member))
+
+#define ELF_SIZE(type) (is64 ? sizeof(Elf64_##type) : sizeof(Elf32_##type))
+
+namespace {
+
+// Bounds checked reads of the file's fields, independent of host endianness and alignment
+class Reader
+{
+public:
+    Reader(const uchar *data, qint64 size, bool littleEndian)
+        : mData(data), mSize(size), mLittleEndian(littleEndian), mOk(true)
+    {
+    }
+
+    quint64 get(quint64 base, size_t offset, size_t size)
+    {
+        if (base > quint64(mSize) || base + offset + size > quint64(mSize)) {
+            mOk = false;
+            return 0;
+        }
+        const uchar *p = mData + base + offset;
+        switch (size) {
+        case 1: return *p;
+        case 2: return mLittleEndian ? qFromLittleEndian<quint16>(p) : qFromBigEndian<quint16>(p);
+        case 4: return mLittleEndian ? qFromLittleEndian<quint32>(p) : qFromBigEndian<quint32>(p);
+        default: return mLittleEndian ? qFromLittleEndian<quint64>(p) : qFromBigEndian<quint64>(p);
+        }
+    }
+
+    QByteArray string(quint64 offset, quint64 end)
+    {
+        if (offset >= end || end > quint64(mSize)) {
+            mOk = false;
+            return QByteArray();
+        }
+        const char *start = reinterpret_cast<const char *>(mData + offset);
+        return QByteArray(start, int(qstrnlen(start, uint(end - offset))));
+    }
+
+    bool ok() const { return mOk; }
+
+private:
+    const uchar *mData;
+    qint64 mSize;
+    bool mLittleEndian;
+    bool mOk;
+};
+
+struct Segment {
+    quint64 vaddr;
+    quint64 offset;
+    quint64 size;
+};
+
+// files receives the configuration files and the directories of include patterns
+void readLdSoConf(const QString &fileName, QStringList *dirs, QStringList *files, int depth)
+{
+    if (depth > 8)
+        return;
+    files->append(fileName);
+    QFile f(fileName);
+    if (!f.open(QFile::ReadOnly | QFile::Text))
+        return;
+
+    while (!f.atEnd()) {
+        QString line = QString::fromLocal8Bit(f.readLine());
+        const int hash = line.indexOf(QLatin1Char('#'));
+        if (hash >= 0)
+            line.truncate(hash);
+        line = line.trimmed();
+        if (line.isEmpty())
+            continue;
+
+        if (line.startsWith(QLatin1String("include "))) {
+            QString pattern = line.mid(8).trimmed();
+            if (QDir::isRelativePath(pattern))
+                pattern = QFileInfo(fileName).absolutePath() + QLatin1Char('/') + pattern;
+            const QFileInfo info(pattern);
+            const QDir dir(info.absolutePath(), info.fileName(), QDir::Name, QDir::Files);
+            files->append(info.absolutePath());
+            foreach (const QString &entry, dir.entryList())
+                readLdSoConf(dir.filePath(entry), dirs, files, depth + 1);
+        } else if (!line.startsWith(QLatin1String("hwcap "))) {
+            dirs->append(line);
+        }
+    }
+}
+
+QStringList systemLibraryPath(QStringList *configFiles)
+{
+    static QStringList path;
+    static QStringList files;
+    if (path.isEmpty()) {
+        readLdSoConf(QLatin1String("/etc/ld.so.conf"), &path, &files, 0);
+        path << QLatin1String("/lib") << QLatin1String("/usr/lib")
+             << QLatin1String("/lib64") << QLatin1String("/usr/lib64")
+             << QLatin1String("/system/lib") << QLatin1String("/system/lib64")
+             << QLatin1String("/vendor/lib") << QLatin1String("/vendor/lib64");
+    }
+    *configFiles = files;
+    return path;
+}
+
+} // anonymous namespace
+
+ElfFile::ElfFile()
+    : mElfClass(ELFCLASSNONE)
+    , mType(ET_NONE)
+    , mMachine(EM_NONE)
+    , mLittleEndian(true)
+{
+}
+
+bool ElfFile::load(const QString &fileName)
+{
+    mFileName = fileName;
+    mErrorString.clear();
+    mInterpreter.clear();
+    mNeeded.clear();
+    mRpath.clear();
+    mRunpath.clear();
+
+    QFile f(fileName);
+    if (!f.open(QFile::ReadOnly)) {
+        mErrorString = QLatin1String("Could not open ") + fileName;
+        return false;
+    }
+    if (f.size() < EI_NIDENT) {
+        mErrorString = fileName + QLatin1String(" is too small to be an ELF file");
+        return false;
+    }
+    const uchar *data = f.map(0, f.size());
+    if (!data) {
+        mErrorString = QLatin1String("Could not map ") + fileName;
+        return false;
+    }
+    const bool ok = parse(data, f.size());
+    f.unmap(const_cast<uchar *>(data));
+    return ok;
+}
+
+bool ElfFile::parse(const uchar *data, qint64 size)
+{
+    if (memcmp(data, ELFMAG, SELFMAG) != 0) {
+        mErrorString = mFileName + QLatin1String(" is not an ELF file");
+        return false;
+    }
+    mElfClass = data[EI_CLASS];
+    if (mElfClass != ELFCLASS32 && mElfClass != ELFCLASS64) {
+        mErrorString = mFileName + QLatin1String(" has an unknown ELF class");
+        return false;
+    }
+    if (data[EI_DATA] != ELFDATA2LSB && data[EI_DATA] != ELFDATA2MSB) {
+        mErrorString = mFileName + QLatin1String(" has an unknown byte order");
+        return false;
+    }
+    mLittleEndian = data[EI_DATA] == ELFDATA2LSB;
+
+    const bool is64 = mElfClass == ELFCLASS64;
+    Reader reader(data, size, mLittleEndian);
+    mType = reader.get(0, ELF_FIELD(Ehdr, e_type));
+    mMachine = reader.get(0, ELF_FIELD(Ehdr, e_machine));
+    const quint64 phoff = reader.get(0, ELF_FIELD(Ehdr, e_phoff));
+    const quint64 phentsize = reader.get(0, ELF_FIELD(Ehdr, e_phentsize));
+    const quint64 phnum = reader.get(0, ELF_FIELD(Ehdr, e_phnum));
+    if (!reader.ok() || (phnum && phentsize < ELF_SIZE(Phdr))) {
+        mErrorString = mFileName + QLatin1String(" has a truncated ELF header");
+        return false;
+    }
+
+    QVector<Segment> loads;
+    quint64 dynamicOffset = 0;
+    quint64 dynamicSize = 0;
+    for (quint64 i = 0; i < phnum; ++i) {
+        const quint64 ph = phoff + i * phentsize;
+        const quint64 type = reader.get(ph, ELF_FIELD(Phdr, p_type));
+        const quint64 offset = reader.get(ph, ELF_FIELD(Phdr, p_offset));
+        const quint64 fileSize = reader.get(ph, ELF_FIELD(Phdr, p_filesz));
+        if (type == PT_INTERP) {
+            mInterpreter = QString::fromLocal8Bit(reader.string(offset, offset + fileSize));
+        } else if (type == PT_DYNAMIC) {
+            dynamicOffset = offset;
+            dynamicSize = fileSize;
+        } else if (type == PT_LOAD) {
+            Segment segment = { reader.get(ph, ELF_FIELD(Phdr, p_vaddr)), offset, fileSize };
+            loads.append(segment);
+        }
+    }
+    if (!reader.ok()) {
+        mErrorString = mFileName + QLatin1String(" has truncated program headers");
+        return false;
+    }
+    if (!dynamicSize)
+        return true; // statically linked
+
+    QVector<quint64> needed;
+    QVector<quint64> rpath;
+    QVector<quint64> runpath;
+    quint64 strtab = 0;
+    quint64 strsz = 0;
+    for (quint64 dyn = dynamicOffset; dyn + ELF_SIZE(Dyn) <= dynamicOffset + dynamicSize;
+         dyn += ELF_SIZE(Dyn)) {
+        const quint64 tag = reader.get(dyn, ELF_FIELD(Dyn, d_tag));
+        const quint64 value = reader.get(dyn, ELF_FIELD(Dyn, d_un));
+        if (tag == DT_NULL || !reader.ok())
+            break;
+        if (tag == DT_NEEDED)
+            needed.append(value);
+        else if (tag == DT_RPATH)
+            rpath.append(value);
+        else if (tag == DT_RUNPATH)
+            runpath.append(value);
+        else if (tag == DT_STRTAB)
+            strtab = value;
+        else if (tag == DT_STRSZ)
+            strsz = value;
+    }
+
+    // DT_STRTAB is an address, find the file offset of the segment holding it
+    quint64 strtabOffset = 0;
+    bool found = false;
+    foreach (const Segment &segment, loads) {
+        if (strtab >= segment.vaddr && strtab < segment.vaddr + segment.size) {
+            strtabOffset = strtab - segment.vaddr + segment.offset;
+            found = true;
+            break;
+        }
+    }
+    if (!reader.ok() || !found) {
+        mErrorString = mFileName + QLatin1String(" has a broken dynamic section");
+        return false;
+    }
+
+    const quint64 strtabEnd = qMin(strtabOffset + strsz, quint64(size));
+    foreach (quint64 offset, needed)
+        mNeeded.append(reader.string(strtabOffset + offset, strtabEnd));
+    foreach (quint64 offset, rpath)
+        mRpath += searchPath(reader.string(strtabOffset + offset, strtabEnd));
+    foreach (quint64 offset, runpath)
+        mRunpath += searchPath(reader.string(strtabOffset + offset, strtabEnd));
+    if (!reader.ok()) {
+        mErrorString = mFileName + QLatin1String(" has a broken string table");
+        return false;
+    }
+    return true;
+}
+
+QStringList ElfFile::searchPath(const QByteArray &value) const
+{
+    const QString origin = QFileInfo(mFileName).absolutePath();
+    QStringList dirs;
+    foreach (QString dir, QString::fromLocal8Bit(value).split(QLatin1Char(':'), QString::SkipEmptyParts)) {
+        dir.replace(QLatin1String("${ORIGIN}"), origin);
+        dir.replace(QLatin1String("$ORIGIN"), origin);
+        dirs.append(dir);
+    }
+    return dirs;
+}
+
+bool ElfFile::isCompatible(const ElfFile &other) const
+{
+    return mElfClass == other.mElfClass && mMachine == other.mMachine
+            && mLittleEndian == other.mLittleEndian;
+}
+
+ElfDependencies ElfDependencies::resolve(const ElfFile &binary, const QStringList &libraryPath)
+{
+    ElfDependencies dependencies;
+    dependencies.interpreter = binary.interpreter();
+
+    const QStringList systemPath = systemLibraryPath(&dependencies.searched);
+    QSet<QString> searched;
+    QSet<QByteArray> seen;
+    QList<ElfFile> queue;
+    queue.append(binary);
+    for (int i = 0; i < queue.size(); ++i) {
+        const ElfFile object = queue.at(i);
+        foreach (const QByteArray &soname, object.needed()) {
+            if (seen.contains(soname))
+                continue;
+            seen.insert(soname);
+
+            QStringList candidates;
+            if (soname.contains('/')) {
+                candidates.append(QString::fromLocal8Bit(soname));
+            } else {
+                QStringList dirs;
+                if (object.runpath().isEmpty()) {
+                    dirs += object.rpath();
+                    if (i > 0)
+                        dirs += binary.rpath();
+                }
+                dirs += libraryPath;
+                dirs += object.runpath();
+                dirs += systemPath;
+                foreach (const QString &dir, dirs)
+                    candidates.append(dir + QLatin1Char('/') + QString::fromLocal8Bit(soname));
+            }
+
+            bool found = false;
+            foreach (const QString &candidate, candidates) {
+                ElfFile library;
+                if (library.load(candidate) && binary.isCompatible(library)) {
+                    dependencies.libraries.append(candidate);
+                    queue.append(library);
+                    found = true;
+                    break;
+                }
+                // A library appearing here later would be found first
+                const QString dir = QFileInfo(candidate).absolutePath();
+                if (!searched.contains(dir)) {
+                    searched.insert(dir);
+                    dependencies.searched.append(dir);
+                }
+            }
+            if (!found)
+                dependencies.missing.append(QString::fromLocal8Bit(soname));
+        }
+    }
+    return dependencies;
+}
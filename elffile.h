@@ -0,0 +1,80 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef ELFFILE_H
+#define ELFFILE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+
+// The parts of an ELF file the dynamic loader looks at: the header, PT_INTERP and
+// DT_NEEDED, DT_RPATH and DT_RUNPATH of the dynamic section.
+class ElfFile
+{
+public:
+    ElfFile();
+
+    bool load(const QString &fileName);
+    QString errorString() const { return mErrorString; }
+
+    QString fileName() const { return mFileName; }
+    int elfClass() const { return mElfClass; }
+    int type() const { return mType; }
+    int machine() const { return mMachine; }
+    bool isLittleEndian() const { return mLittleEndian; }
+    QString interpreter() const { return mInterpreter; }
+    QList<QByteArray> needed() const { return mNeeded; }
+    QStringList rpath() const { return mRpath; }
+    QStringList runpath() const { return mRunpath; }
+
+    // Whether the loader would accept the other file as a library of this one
+    bool isCompatible(const ElfFile &other) const;
+
+private:
+    bool parse(const uchar *data, qint64 size);
+    QStringList searchPath(const QByteArray &value) const;
+
+    QString mFileName;
+    QString mErrorString;
+    int mElfClass;
+    int mType;
+    int mMachine;
+    bool mLittleEndian;
+    QString mInterpreter;
+    QList<QByteArray> mNeeded;
+    QStringList mRpath;
+    QStringList mRunpath;
+};
+
+// The transitive DT_NEEDED closure of a binary, resolved in the order of the dynamic
+// loader: DT_RPATH (without DT_RUNPATH), LD_LIBRARY_PATH, DT_RUNPATH, ld.so.conf and
+// the default directories.
+struct ElfDependencies
+{
+    QString interpreter;
+    QStringList libraries; // resolved paths, breadth first
+    QStringList missing;   // sonames that could not be resolved
+    QStringList searched;  // ld.so.conf files and directories searched in vain, the result
+                           // changes with them
+
+    static ElfDependencies resolve(const ElfFile &binary, const QStringList &libraryPath);
+};
+
+#endif // ELFFILE_H
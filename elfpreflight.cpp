@@ -0,0 +1,225 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "elfpreflight.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QDataStream>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <elf.h>
+#include <stdio.h>
+
+static const quint32 CacheMagic = 0x42514546; // "BQEF"
+static const qint32 CacheVersion = 2;
+static const int MaxCacheEntries = 32;
+
+namespace {
+
+struct Entry
+{
+    QStringList files;        // everything the result depends on
+    QList<QByteArray> stamps; // of files, in the same order
+    ElfPreflight::Result result;
+};
+
+QHash<QString, Entry> cache;
+QString loadedCacheFile;
+
+QByteArray stamp(const QString &fileName)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(fileName).constData(), &st) != 0)
+        return QByteArray("missing");
+    return QByteArray::number(quint64(st.st_dev)) + ' ' + QByteArray::number(quint64(st.st_ino))
+            + ' ' + QByteArray::number(qint64(st.st_mtim.tv_sec)) + '.'
+            + QByteArray::number(qint64(st.st_mtim.tv_nsec));
+}
+
+bool isUpToDate(const Entry &entry)
+{
+    for (int i = 0; i < entry.files.size(); ++i) {
+        if (stamp(entry.files.at(i)) != entry.stamps.at(i))
+            return false;
+    }
+    return true;
+}
+
+void readCache(const QString &cacheFile)
+{
+    if (loadedCacheFile == cacheFile)
+        return;
+    loadedCacheFile = cacheFile;
+    cache.clear();
+
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    qint32 version;
+    qint32 count;
+    stream >> magic >> version >> count;
+    if (magic != CacheMagic || version != CacheVersion)
+        return;
+
+    QHash<QString, Entry> entries;
+    for (int i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString key;
+        Entry entry;
+        stream >> key >> entry.files >> entry.stamps >> entry.result.error >> entry.result.warnings
+               >> entry.result.dependencies.interpreter >> entry.result.dependencies.libraries
+               >> entry.result.dependencies.missing;
+        if (entry.files.size() == entry.stamps.size())
+            entries.insert(key, entry);
+    }
+    if (stream.status() == QDataStream::Ok)
+        cache = entries;
+}
+
+void writeCache(const QString &cacheFile)
+{
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        printf("Could not write ELF cache %s\n", qPrintable(cacheFile));
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << CacheMagic << CacheVersion << qint32(cache.size());
+    for (QHash<QString, Entry>::const_iterator it = cache.constBegin(); it != cache.constEnd(); ++it) {
+        const Entry &entry = it.value();
+        stream << it.key() << entry.files << entry.stamps << entry.result.error << entry.result.warnings
+               << entry.result.dependencies.interpreter << entry.result.dependencies.libraries
+               << entry.result.dependencies.missing;
+    }
+    if (!file.commit())
+        printf("Could not write ELF cache %s\n", qPrintable(cacheFile));
+}
+
+// Whether the kernel can run binaries for machine. Unknown systems accept everything.
+bool isRunnable(int machine)
+{
+    struct utsname name;
+    if (uname(&name) != 0)
+        return true;
+    const QByteArray system(name.machine);
+    if (system == "x86_64")
+        return machine == EM_X86_64 || machine == EM_386;
+    if (system.startsWith('i') && system.endsWith("86"))
+        return machine == EM_386;
+    if (system == "aarch64" || system == "arm64")
+        return machine == EM_AARCH64 || machine == EM_ARM;
+    if (system.startsWith("arm"))
+        return machine == EM_ARM;
+    if (system.startsWith("mips"))
+        return machine == EM_MIPS;
+    return true;
+}
+
+QString machineName(int machine)
+{
+    switch (machine) {
+    case EM_386: return QLatin1String("x86");
+    case EM_X86_64: return QLatin1String("x86-64");
+    case EM_ARM: return QLatin1String("ARM");
+    case EM_AARCH64: return QLatin1String("AArch64");
+    case EM_MIPS: return QLatin1String("MIPS");
+    default: return QLatin1String("machine ") + QString::number(machine);
+    }
+}
+
+ElfPreflight::Result analyze(const QString &binary, const QStringList &libraryPath)
+{
+    ElfPreflight::Result result;
+
+    QFile f(binary);
+    if (f.open(QFile::ReadOnly) && f.peek(2) == "#!")
+        return result; // Scripts are left to their interpreter
+    f.close();
+
+    ElfFile elf;
+    if (!elf.load(binary)) {
+        result.error = elf.errorString();
+        return result;
+    }
+    if (elf.type() != ET_EXEC && elf.type() != ET_DYN) {
+        result.error = binary + QLatin1String(" is not an executable");
+        return result;
+    }
+    if (!isRunnable(elf.machine())) {
+        struct utsname name;
+        uname(&name);
+        result.error = binary + QLatin1String(" is built for ") + machineName(elf.machine())
+                + QLatin1String(", this device is ") + QLatin1String(name.machine);
+        return result;
+    }
+
+    result.dependencies = ElfDependencies::resolve(elf, libraryPath);
+    const QString interpreter = result.dependencies.interpreter;
+    if (!interpreter.isEmpty() && !QFileInfo(interpreter).isFile()) {
+        result.error = binary + QLatin1String(" requires the interpreter ") + interpreter
+                + QLatin1String(", which does not exist");
+        return result;
+    }
+    foreach (const QString &soname, result.dependencies.missing)
+        result.warnings.append(QLatin1String("Library ") + soname + QLatin1String(" was not found"));
+    return result;
+}
+
+} // anonymous namespace
+
+namespace ElfPreflight {
+
+Result check(const QString &binary, const QStringList &libraryPath, const QString &cacheFile)
+{
+    const QString path = QFileInfo(binary).absoluteFilePath();
+    const QString key = path + QLatin1Char('\0') + libraryPath.join(QLatin1Char(':'));
+
+    readCache(cacheFile);
+    QHash<QString, Entry>::const_iterator it = cache.constFind(key);
+    if (it != cache.constEnd() && isUpToDate(it.value()))
+        return it.value().result;
+
+    Entry entry;
+    entry.result = analyze(path, libraryPath);
+
+    // Missing libraries may appear anywhere in the search path, such results are not cached
+    if (entry.result.dependencies.missing.isEmpty()) {
+        entry.files << path;
+        if (!entry.result.dependencies.interpreter.isEmpty())
+            entry.files << entry.result.dependencies.interpreter;
+        entry.files += entry.result.dependencies.libraries;
+        // Directory mtimes change when a library is added to a directory searched earlier
+        entry.files += entry.result.dependencies.searched;
+        foreach (const QString &file, entry.files)
+            entry.stamps.append(stamp(file));
+
+        cache.remove(key);
+        while (cache.size() >= MaxCacheEntries)
+            cache.erase(cache.begin());
+        cache.insert(key, entry);
+        writeCache(cacheFile);
+    }
+    return entry.result;
+}
+
+} // namespace ElfPreflight
@@ -0,0 +1,45 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef ELFPREFLIGHT_H
+#define ELFPREFLIGHT_H
+
+#include "elffile.h"
+
+// Checks before the launch whether the loader will accept a binary: its ELF header,
+// the architecture, the interpreter and the DT_NEEDED closure. Results are kept in
+// memory and on disk, keyed by inode and mtime of the binary, its interpreter, its
+// libraries, ld.so.conf with its includes and the directories searched before each
+// library was found, so repeated launches of the same binary only stat files.
+namespace ElfPreflight {
+
+struct Result
+{
+    QString error;         // why the binary cannot be started, empty if it can
+    QStringList warnings;  // problems the loader may still work around
+    ElfDependencies dependencies;
+
+    bool isValid() const { return error.isEmpty(); }
+};
+
+// binary must be an existing file. Scripts pass without dependencies.
+Result check(const QString &binary, const QStringList &libraryPath, const QString &cacheFile);
+
+} // namespace ElfPreflight
+
+#endif // ELFPREFLIGHT_H
@@ -0,0 +1,187 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "framedoutput.h"
+#include <QSocketNotifier>
+#include <QtEndian>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int HeaderSize = 16;
+static const int BatchSize = 64 * 1024;
+static const int FlushInterval = 10; // ms
+static const int ControllerPipeSize = 256 * 1024;
+
+static quint64 monotonicNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return quint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+FramedOutput::FramedOutput(int fd, QObject *parent)
+    : QObject(parent)
+    , mFd(fcntl(fd, F_DUPFD_CLOEXEC, 0))
+    , mControllerPipe(-1)
+    , mSavedStdout(-1)
+    , mSavedStderr(-1)
+    , mControllerNotifier(0)
+    , mFailed(false)
+{
+    mBatch.reserve(BatchSize + HeaderSize);
+    mBatch.append(FramedOutputMagic, FramedOutputMagicSize);
+
+    mFlushTimer.setSingleShot(true);
+    mFlushTimer.setInterval(FlushInterval);
+    connect(&mFlushTimer, &QTimer::timeout, this, &FramedOutput::flush);
+}
+
+FramedOutput::~FramedOutput()
+{
+    finish();
+    if (mSavedStdout >= 0) {
+        dup2(mSavedStdout, STDOUT_FILENO);
+        close(mSavedStdout);
+    }
+    if (mSavedStderr >= 0) {
+        dup2(mSavedStderr, STDERR_FILENO);
+        close(mSavedStderr);
+    }
+    if (mControllerPipe >= 0)
+        close(mControllerPipe);
+    if (mFd >= 0)
+        close(mFd);
+}
+
+bool FramedOutput::captureControllerOutput()
+{
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) != 0) {
+        perror("Could not create pipe for controller output");
+        return false;
+    }
+
+    // Never block on our own messages, the event loop is the only reader
+    fcntl(pipefd[1], F_SETPIPE_SZ, ControllerPipeSize);
+    fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    fflush(stdout);
+    fflush(stderr);
+    mSavedStdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    mSavedStderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(pipefd[1], STDOUT_FILENO);
+    dup2(pipefd[1], STDERR_FILENO);
+    close(pipefd[1]);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    mControllerPipe = pipefd[0];
+    return true;
+}
+
+void FramedOutput::watchControllerOutput()
+{
+    if (mControllerPipe < 0 || mControllerNotifier)
+        return;
+    mControllerNotifier = new QSocketNotifier(mControllerPipe, QSocketNotifier::Read, this);
+    connect(mControllerNotifier, &QSocketNotifier::activated, this, &FramedOutput::readControllerOutput);
+    readControllerOutput();
+}
+
+void FramedOutput::append(Stream stream, const char *data, int size)
+{
+    if (size <= 0)
+        return;
+
+    uchar header[HeaderSize];
+    memset(header, 0, sizeof(header));
+    header[0] = stream;
+    qToBigEndian<quint32>(size, header + 4);
+    qToBigEndian<quint64>(monotonicNs(), header + 8);
+    mBatch.append(reinterpret_cast<const char *>(header), HeaderSize);
+    mBatch.append(data, size);
+
+    if (mBatch.size() >= BatchSize)
+        flush();
+    else if (!mFlushTimer.isActive())
+        mFlushTimer.start();
+}
+
+void FramedOutput::finish()
+{
+    if (mControllerPipe >= 0) {
+        fflush(stdout);
+        fflush(stderr);
+        readControllerOutput();
+    }
+    flush();
+}
+
+void FramedOutput::flush()
+{
+    mFlushTimer.stop();
+    if (mBatch.isEmpty())
+        return;
+    if (!mFailed && !writeAll(mBatch.constData(), mBatch.size())) {
+        mFailed = true;
+        // stderr may be our own pipe, so report on the original descriptor
+        const int fd = mSavedStderr >= 0 ? mSavedStderr : STDERR_FILENO;
+        dprintf(fd, "AppController: Cannot write framed output: %s\n", strerror(errno));
+    }
+    mBatch.resize(0);
+}
+
+void FramedOutput::readControllerOutput()
+{
+    char buffer[4096];
+    forever {
+        const ssize_t size = read(mControllerPipe, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            return;
+        append(Controller, buffer, size);
+    }
+}
+
+bool FramedOutput::writeAll(const char *data, int size)
+{
+    while (size > 0) {
+        const ssize_t written = write(mFd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+                pfd.fd = mFd;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                    continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef FRAMEDOUTPUT_H
+#define FRAMEDOUTPUT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QTimer>
+
+class QSocketNotifier;
+
+// Multiplexes stdout and stderr of the application and the controller's own messages
+// into frames on a single descriptor, so that a client can tell the streams apart and
+// see when each chunk was read.
+//
+// The stream starts with FramedOutputMagic, followed by frames of
+//   quint8  stream     see Stream
+//   quint8  reserved[3]
+//   quint32 length     of the payload, big endian
+//   quint64 timestamp  CLOCK_MONOTONIC in ns when the data was read, big endian
+//   payload
+// Frames are collected and written in batches.
+static const char FramedOutputMagic[] = "QFRAMED1";
+static const int FramedOutputMagicSize = sizeof(FramedOutputMagic) - 1;
+
+class FramedOutput : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stream {
+        StandardOutput = 0,
+        StandardError = 1,
+        Controller = 2
+    };
+
+    // Frames are written to a duplicate of fd
+    explicit FramedOutput(int fd, QObject *parent = 0);
+    ~FramedOutput();
+
+    // Redirects the controller's own stdout and stderr into Controller frames. This may
+    // happen before the QCoreApplication exists, the captured messages are only read
+    // once watchControllerOutput() was called from the event loop thread.
+    bool captureControllerOutput();
+    void watchControllerOutput();
+
+    void append(Stream stream, const char *data, int size);
+    void finish();
+
+private slots:
+    void flush();
+    void readControllerOutput();
+
+private:
+    bool writeAll(const char *data, int size);
+
+    int mFd;
+    QByteArray mBatch;
+    QTimer mFlushTimer;
+    int mControllerPipe;
+    int mSavedStdout;
+    int mSavedStderr;
+    QSocketNotifier *mControllerNotifier;
+    bool mFailed;
+};
+
+#endif // FRAMEDOUTPUT_H
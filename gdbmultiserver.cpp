@@ -0,0 +1,258 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+
+#include "gdbmultiserver.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringList>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int StartTimeout = 5000; // ms until gdbserver has to listen
+static const int PollInterval = 20;   // ms
+
+GdbMultiServer::GdbMultiServer(const QString &directory)
+    : mDirectory(directory)
+    , mPid(0)
+    , mPort(0)
+{
+}
+
+bool GdbMultiServer::isRunning()
+{
+    if (!mPid && !load())
+        return false;
+    // The pid may have been reused since the state was written
+    return kill(mPid, 0) == 0 && isGdbServer(mPid) && isListening(mPort);
+}
+
+bool GdbMultiServer::start(int port, const QString &interface)
+{
+    const QString program = QStandardPaths::findExecutable(QLatin1String("gdbserver"));
+    if (program.isEmpty()) {
+        mErrorString = QLatin1String("gdbserver is not installed");
+        return false;
+    }
+    if (!checkDirectory(true))
+        return false;
+
+    // Everything the child needs is prepared before the fork
+    const QByteArray programName = QFile::encodeName(program);
+    const QByteArray address = (interface + QLatin1Char(':') + QString::number(port)).toLatin1();
+    const QByteArray logName = QFile::encodeName(logFile());
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        mErrorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    const pid_t child = fork();
+    if (child < 0) {
+        mErrorString = QString::fromLocal8Bit(strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (child == 0) {
+        // Neither signals to our process group nor a hangup of the host's connection
+        // may reach the server, and it is reparented once the intermediate child exits
+        setsid();
+        const pid_t server = fork();
+        if (server != 0) {
+            // The parent notices a short write as a failed fork
+            if (server > 0 && write(fds[1], &server, sizeof(server)) < 0) { }
+            _exit(server > 0 ? 0 : 1);
+        }
+        const int devnull = open("/dev/null", O_RDONLY);
+        const int log = open(logName.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0600);
+        if (devnull >= 0)
+            dup2(devnull, STDIN_FILENO);
+        if (log >= 0) {
+            dup2(log, STDOUT_FILENO);
+            dup2(log, STDERR_FILENO);
+        }
+        if (chdir("/") != 0)
+            _exit(127);
+        execl(programName.constData(), "gdbserver", "--multi", address.constData(), (char *)0);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    while (waitpid(child, 0, 0) < 0 && errno == EINTR) { }
+    pid_t server = 0;
+    ssize_t size;
+    do {
+        size = read(fds[0], &server, sizeof(server));
+    } while (size < 0 && errno == EINTR);
+    close(fds[0]);
+    if (size != sizeof(server) || server <= 0) {
+        mErrorString = QLatin1String("Could not fork");
+        return false;
+    }
+
+    // The host may connect as soon as the port is printed
+    for (int waited = 0; !isListening(port); waited += PollInterval) {
+        if (kill(server, 0) != 0 || waited >= StartTimeout) {
+            kill(server, SIGKILL);
+            mErrorString = QString::fromLatin1("gdbserver did not start listening on port %1, see %2")
+                    .arg(port).arg(QFile::decodeName(logName));
+            return false;
+        }
+        usleep(PollInterval * 1000);
+    }
+
+    mPid = server;
+    mPort = port;
+    mInterface = interface;
+    if (!save())
+        fprintf(stderr, "AppController: Could not write %s, gdbserver is not reused\n",
+                qPrintable(stateFile()));
+    return true;
+}
+
+void GdbMultiServer::stop()
+{
+    if (isRunning() && kill(mPid, SIGTERM) != 0)
+        perror("Could not stop gdbserver");
+    if (checkDirectory(false))
+        QFile::remove(stateFile());
+    mPid = 0;
+    mPort = 0;
+    mInterface.clear();
+}
+
+pid_t GdbMultiServer::pid() const
+{
+    return mPid;
+}
+
+int GdbMultiServer::port() const
+{
+    return mPort;
+}
+
+QString GdbMultiServer::interface() const
+{
+    return mInterface;
+}
+
+QString GdbMultiServer::errorString() const
+{
+    return mErrorString;
+}
+
+// Anybody else able to write to the directory could redirect the state or the log through
+// symlinks, e.g. to have a file of root truncated
+bool GdbMultiServer::checkDirectory(bool create)
+{
+    const QByteArray path = QFile::encodeName(mDirectory);
+    if (create && mkdir(path.constData(), 0700) != 0 && errno != EEXIST) {
+        mErrorString = QString::fromLatin1("Could not create %1: %2")
+                .arg(mDirectory).arg(QString::fromLocal8Bit(strerror(errno)));
+        return false;
+    }
+    struct stat info;
+    if (lstat(path.constData(), &info) != 0)
+        return false;
+    if (!S_ISDIR(info.st_mode) || info.st_uid != geteuid() || (info.st_mode & 077) != 0) {
+        mErrorString = QString::fromLatin1("%1 is not a directory accessible only by the current user")
+                .arg(mDirectory);
+        return false;
+    }
+    return true;
+}
+
+QString GdbMultiServer::stateFile() const
+{
+    return mDirectory + QLatin1String("/state");
+}
+
+QString GdbMultiServer::logFile() const
+{
+    return mDirectory + QLatin1String("/gdbserver.log");
+}
+
+bool GdbMultiServer::load()
+{
+    if (!checkDirectory(false))
+        return false;
+    QFile file(stateFile());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QList<QByteArray> fields = file.readLine().trimmed().split(' ');
+    if (fields.size() < 2)
+        return false;
+    mPid = fields.at(0).toInt();
+    mPort = fields.at(1).toInt();
+    mInterface = QString::fromLatin1(fields.value(2));
+    return mPid > 0 && mPort > 0;
+}
+
+bool GdbMultiServer::save()
+{
+    QSaveFile file(stateFile());
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(QByteArray::number(mPid) + ' ' + QByteArray::number(mPort) + ' '
+               + mInterface.toLatin1() + '\n');
+    return file.commit();
+}
+
+bool GdbMultiServer::isGdbServer(pid_t pid)
+{
+    QFile file(QString::fromLatin1("/proc/%1/cmdline").arg(pid));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QList<QByteArray> args = file.readAll().split('\0');
+    return QFileInfo(QFile::decodeName(args.first())).fileName() == QLatin1String("gdbserver")
+            && args.contains("--multi");
+}
+
+// Lines of /proc/net/tcp look like "  12: 0100007F:0CEA 00000000:0000 0A ...", with
+// the local port after the second colon and 0A being LISTEN
+bool GdbMultiServer::isListening(int port)
+{
+    static const char * const fileNames[] = { "/proc/net/tcp", "/proc/net/tcp6" };
+    for (unsigned i = 0; i < sizeof(fileNames) / sizeof(fileNames[0]); ++i) {
+        QFile file(QLatin1String(fileNames[i]));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        // procfs files have no size, so they are read in one go instead of line by line
+        const QList<QByteArray> lines = file.readAll().split('\n');
+        for (int line = 1; line < lines.size(); ++line) {
+            const QList<QByteArray> fields = lines.at(line).simplified().split(' ');
+            if (fields.size() < 4 || fields.at(3) != "0A")
+                continue;
+            const int colon = fields.at(1).lastIndexOf(':');
+            bool ok = false;
+            if (colon >= 0 && fields.at(1).mid(colon + 1).toInt(&ok, 16) == port && ok)
+                return true;
+        }
+    }
+    return false;
+}
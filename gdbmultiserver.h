@@ -0,0 +1,62 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+
+#ifndef GDBMULTISERVER_H
+#define GDBMULTISERVER_H
+
+#include <QString>
+#include <sys/types.h>
+
+// A single "gdbserver --multi" that outlives the launches, so that the host stays
+// connected and only attaches to each new application. The server runs in its own
+// session and is recorded as "<pid> <port> <interface>" in a state file, where the next
+// launch finds it again. The state file and gdbserver's output are kept in a directory
+// only accessible by the controller's user, which is refused otherwise.
+class GdbMultiServer
+{
+public:
+    explicit GdbMultiServer(const QString &directory);
+
+    // Whether the recorded server is still alive and listening
+    bool isRunning();
+    bool start(int port, const QString &interface);
+    void stop();
+
+    pid_t pid() const;
+    int port() const;
+    QString interface() const;
+    QString errorString() const;
+
+private:
+    bool checkDirectory(bool create);
+    QString stateFile() const;
+    QString logFile() const;
+    bool load();
+    bool save();
+    static bool isGdbServer(pid_t pid);
+    static bool isListening(int port);
+
+    QString mDirectory;
+    pid_t mPid;
+    int mPort;
+    QString mInterface;
+    QString mErrorString;
+};
+
+#endif // GDBMULTISERVER_H
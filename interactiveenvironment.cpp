@@ -0,0 +1,329 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "interactiveenvironment.h"
+#include <QProcess>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <sys/stat.h>
+#include <stdio.h>
+
+static const quint32 CacheMagic = 0x42514545; // "BQEE"
+static const qint32 CacheVersion = 1;
+
+static inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Unescapes the contents of $'...' starting after the opening quote.
+// Returns the position after the closing quote.
+static int parseAnsiQuoted(const QByteArray &data, int pos, QByteArray *word)
+{
+    const int size = data.size();
+    while (pos < size && data.at(pos) != '\'') {
+        char c = data.at(pos++);
+        if (c != '\\' || pos >= size) {
+            word->append(c);
+            continue;
+        }
+
+        c = data.at(pos++);
+        switch (c) {
+        case 'a': word->append('\a'); break;
+        case 'b': word->append('\b'); break;
+        case 'e':
+        case 'E': word->append('\033'); break;
+        case 'f': word->append('\f'); break;
+        case 'n': word->append('\n'); break;
+        case 'r': word->append('\r'); break;
+        case 't': word->append('\t'); break;
+        case 'v': word->append('\v'); break;
+        case 'x': {
+            int value = 0;
+            int digits = 0;
+            while (digits < 2 && pos < size && hexValue(data.at(pos)) >= 0) {
+                value = value * 16 + hexValue(data.at(pos++));
+                ++digits;
+            }
+            if (digits)
+                word->append(char(value));
+            else
+                word->append("\\x");
+            break;
+        }
+        default:
+            if (c >= '0' && c <= '7') {
+                int value = c - '0';
+                for (int digits = 1; digits < 3 && pos < size
+                     && data.at(pos) >= '0' && data.at(pos) <= '7'; ++digits)
+                    value = value * 8 + data.at(pos++) - '0';
+                word->append(char(value));
+            } else {
+                // \\, \', \" and \? stand for themselves
+                word->append(c);
+            }
+            break;
+        }
+    }
+    return pos + 1;
+}
+
+// Parses one shell word starting at pos and appends its unquoted value to word.
+// Returns the position of the first unquoted blank or newline after the word.
+static int parseWord(const QByteArray &data, int pos, QByteArray *word)
+{
+    const int size = data.size();
+    while (pos < size) {
+        const char c = data.at(pos);
+        if (isBlank(c) || c == '\n')
+            break;
+
+        if (c == '\'') {
+            int end = data.indexOf('\'', pos + 1);
+            if (end < 0)
+                end = size;
+            word->append(data.constData() + pos + 1, end - pos - 1);
+            pos = end + 1;
+        } else if (c == '"') {
+            ++pos;
+            while (pos < size && data.at(pos) != '"') {
+                if (data.at(pos) == '\\' && pos + 1 < size) {
+                    const char next = data.at(pos + 1);
+                    if (next == '\n') {
+                        pos += 2;
+                        continue;
+                    }
+                    if (next == '"' || next == '\\' || next == '$' || next == '`') {
+                        word->append(next);
+                        pos += 2;
+                        continue;
+                    }
+                }
+                word->append(data.at(pos++));
+            }
+            ++pos;
+        } else if (c == '$' && pos + 1 < size && data.at(pos + 1) == '\'') {
+            pos = parseAnsiQuoted(data, pos + 2, word);
+        } else if (c == '\\' && pos + 1 < size) {
+            if (data.at(pos + 1) != '\n')
+                word->append(data.at(pos + 1));
+            pos += 2;
+        } else {
+            word->append(c);
+            ++pos;
+        }
+    }
+    return qMin(pos, size);
+}
+
+static bool startsWithAt(const QByteArray &data, int pos, const char *prefix, int length)
+{
+    return pos + length <= data.size() && qstrncmp(data.constData() + pos, prefix, length) == 0;
+}
+
+static QByteArray fileKey(const QString &fileName)
+{
+    const QByteArray path = QFile::encodeName(fileName);
+    QByteArray key = path;
+
+    struct stat st;
+    if (stat(path.constData(), &st) != 0)
+        return key + QByteArray("\0missing", 8);
+
+    key += '\0' + QByteArray::number(qint64(st.st_mtim.tv_sec))
+         + '.' + QByteArray::number(qint64(st.st_mtim.tv_nsec))
+         + '\0' + QByteArray::number(qint64(st.st_size));
+
+    // mtime and size catch nearly every change, the hash catches the rest
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(&file);
+        key += '\0' + hash.result();
+    }
+    return key;
+}
+
+static QByteArray cacheKey(const QStringList &rcFiles)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    foreach (const QString &rcFile, rcFiles) {
+        hash.addData(fileKey(rcFile));
+        hash.addData("\0", 1);
+    }
+
+    // The shell inherits our environment, so it is part of the result as well
+    QStringList inherited = QProcessEnvironment::systemEnvironment().toStringList();
+    inherited.sort();
+    foreach (const QString &entry, inherited) {
+        hash.addData(entry.toLocal8Bit());
+        hash.addData("\0", 1);
+    }
+    return hash.result();
+}
+
+static bool readCache(const QString &cacheFile, const QByteArray &key, QProcessEnvironment *env)
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic;
+    qint32 version;
+    QByteArray storedKey;
+    QStringList entries;
+    stream >> magic >> version;
+    if (magic != CacheMagic || version != CacheVersion)
+        return false;
+    stream >> storedKey >> entries;
+    if (stream.status() != QDataStream::Ok || storedKey != key)
+        return false;
+
+    foreach (const QString &entry, entries) {
+        const int index = entry.indexOf(QLatin1Char('='));
+        if (index > 0)
+            env->insert(entry.left(index), entry.mid(index + 1));
+    }
+    return true;
+}
+
+static void writeCache(const QString &cacheFile, const QByteArray &key, const QProcessEnvironment &env)
+{
+    QSaveFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        printf("Could not write environment cache %s\n", qPrintable(cacheFile));
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << CacheMagic << CacheVersion << key << env.toStringList();
+    if (!file.commit())
+        printf("Could not write environment cache %s\n", qPrintable(cacheFile));
+}
+
+static QByteArray runShell(const QStringList &rcFiles)
+{
+    QProcess process;
+    process.start("sh");
+    if (!process.waitForStarted(3000)) {
+        printf("Could not start shell.\n");
+        return QByteArray();
+    }
+
+    foreach (const QString &rcFile, rcFiles)
+        process.write("source " + QFile::encodeName(rcFile) + '\n');
+    process.write("export -p\n");
+    process.closeWriteChannel();
+
+    if (!process.waitForFinished(1000)) {
+        printf("did not finish: terminate\n");
+        process.terminate();
+        if (!process.waitForFinished(1000)) {
+            printf("did not terminate: kill\n");
+            process.kill();
+            if (!process.waitForFinished(1000)) {
+                printf("Could not stop process.\n");
+            }
+        }
+    }
+
+    return process.readAllStandardOutput();
+}
+
+namespace InteractiveEnvironment {
+
+QProcessEnvironment parseExports(const QByteArray &output)
+{
+    QProcessEnvironment env;
+    const int size = output.size();
+    int pos = 0;
+    QByteArray value;
+
+    while (pos < size) {
+        while (pos < size && (isBlank(output.at(pos)) || output.at(pos) == '\n'))
+            ++pos;
+
+        if (startsWithAt(output, pos, "export ", 7)) {
+            pos += 7;
+        } else if (startsWithAt(output, pos, "declare -x ", 11)) {
+            pos += 11;
+        } else {
+            pos = output.indexOf('\n', pos);
+            if (pos < 0)
+                break;
+            continue;
+        }
+
+        const int keyStart = pos;
+        while (pos < size && output.at(pos) != '=' && output.at(pos) != '\n' && !isBlank(output.at(pos)))
+            ++pos;
+        const QString key = QString::fromLocal8Bit(output.constData() + keyStart, pos - keyStart);
+
+        value.clear();
+        if (pos < size && output.at(pos) == '=')
+            pos = parseWord(output, pos + 1, &value);
+
+        if (!key.isEmpty())
+            env.insert(key, QString::fromLocal8Bit(value));
+
+        // Quoted values may contain newlines, so only skip the rest of the current line
+        // after the value was parsed
+        pos = output.indexOf('\n', pos);
+        if (pos < 0)
+            break;
+    }
+
+    return env;
+}
+
+QProcessEnvironment load(const QStringList &rcFiles, const QString &cacheFile)
+{
+    const QByteArray key = cacheKey(rcFiles);
+
+    QProcessEnvironment env;
+    if (readCache(cacheFile, key, &env))
+        return env;
+
+    const QByteArray output = runShell(rcFiles);
+    if (output.isEmpty()) {
+        printf("Failed to read environment output\n");
+        return env;
+    }
+
+    env = parseExports(output);
+    if (!env.isEmpty())
+        writeCache(cacheFile, key, env);
+    return env;
+}
+
+} // namespace InteractiveEnvironment
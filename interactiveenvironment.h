@@ -0,0 +1,40 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef INTERACTIVEENVIRONMENT_H
+#define INTERACTIVEENVIRONMENT_H
+
+#include <QProcessEnvironment>
+#include <QByteArray>
+#include <QStringList>
+
+// The environment of an interactive shell, as seen after sourcing the shell rc files.
+// Running the shell is slow, so the result is cached on disk. The cache is keyed by
+// the mtime, size and content hash of the rc files and by the environment inherited
+// from the caller, and is refreshed only when any of them changes.
+namespace InteractiveEnvironment {
+
+QProcessEnvironment load(const QStringList &rcFiles, const QString &cacheFile);
+
+// Parses the output of "export -p" (mksh) or "declare -x" (bash), including
+// single, double and $'...' quoting as well as values spanning several lines.
+QProcessEnvironment parseExports(const QByteArray &output);
+
+} // namespace InteractiveEnvironment
+
+#endif // INTERACTIVEENVIRONMENT_H
@@ -0,0 +1,184 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "launchpolicy.h"
+#include <QStringList>
+#include <sys/prctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char * const Keys[] = {
+    "affinity", "schedPolicy", "schedPriority", "nice", "oomScoreAdj", "memlock", "thp", 0
+};
+
+static void childError(const char *message)
+{
+    // Nothing left to do if stderr fails as well
+    if (write(STDERR_FILENO, message, strlen(message)) < 0) { }
+}
+
+static bool parseCpuList(const QString &list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    foreach (const QString &element, list.split(QLatin1Char(','))) {
+        const QStringList bounds = element.split(QLatin1Char('-'));
+        bool ok1, ok2 = true;
+        const int first = bounds.first().toInt(&ok1);
+        const int last = bounds.size() == 2 ? bounds.last().toInt(&ok2) : first;
+        if (!ok1 || !ok2 || bounds.size() > 2 || first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+        for (int cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, set);
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+static bool parseSize(QString value, rlim_t *size)
+{
+    if (value == QLatin1String("unlimited")) {
+        *size = RLIM_INFINITY;
+        return true;
+    }
+    quint64 factor = 1;
+    if (value.endsWith(QLatin1Char('K')))
+        factor = 1024;
+    else if (value.endsWith(QLatin1Char('M')))
+        factor = 1024 * 1024;
+    else if (value.endsWith(QLatin1Char('G')))
+        factor = 1024 * 1024 * 1024;
+    if (factor > 1)
+        value.chop(1);
+    bool ok;
+    *size = value.toULongLong(&ok) * factor;
+    return ok;
+}
+
+LaunchPolicy::LaunchPolicy()
+    : mHasAffinity(false)
+    , mSchedPolicy(-1)
+    , mSchedPriority(0)
+    , mHasNice(false)
+    , mNice(0)
+    , mHasOomScoreAdj(false)
+    , mHasMemlock(false)
+    , mMemlock(0)
+    , mDisableThp(false)
+{
+    CPU_ZERO(&mAffinity);
+    mOomScoreAdj[0] = 0;
+}
+
+bool LaunchPolicy::isKey(const QString &setting)
+{
+    const QString key = setting.left(setting.indexOf(QLatin1Char('=')));
+    for (int i = 0; Keys[i]; ++i) {
+        if (key == QLatin1String(Keys[i]))
+            return true;
+    }
+    return false;
+}
+
+bool LaunchPolicy::set(const QString &setting)
+{
+    const int index = setting.indexOf(QLatin1Char('='));
+    if (index <= 0)
+        return false;
+    const QString key = setting.left(index);
+    const QString value = setting.mid(index + 1).trimmed();
+    bool ok = false;
+
+    if (key == QLatin1String("affinity")) {
+        ok = mHasAffinity = parseCpuList(value, &mAffinity);
+    } else if (key == QLatin1String("schedPolicy")) {
+        ok = true;
+        if (value == QLatin1String("other"))
+            mSchedPolicy = SCHED_OTHER;
+        else if (value == QLatin1String("batch"))
+            mSchedPolicy = SCHED_BATCH;
+        else if (value == QLatin1String("idle"))
+            mSchedPolicy = SCHED_IDLE;
+        else if (value == QLatin1String("fifo"))
+            mSchedPolicy = SCHED_FIFO;
+        else if (value == QLatin1String("rr"))
+            mSchedPolicy = SCHED_RR;
+        else
+            ok = false;
+    } else if (key == QLatin1String("schedPriority")) {
+        mSchedPriority = value.toInt(&ok);
+        ok = ok && mSchedPriority >= 0 && mSchedPriority <= 99;
+    } else if (key == QLatin1String("nice")) {
+        mNice = value.toInt(&ok);
+        ok = mHasNice = ok && mNice >= -20 && mNice <= 19;
+    } else if (key == QLatin1String("oomScoreAdj")) {
+        const int adj = value.toInt(&ok);
+        ok = mHasOomScoreAdj = ok && adj >= -1000 && adj <= 1000;
+        if (ok) // formatted here, the child must not allocate
+            snprintf(mOomScoreAdj, sizeof(mOomScoreAdj), "%d", adj);
+    } else if (key == QLatin1String("memlock")) {
+        ok = mHasMemlock = parseSize(value, &mMemlock);
+    } else if (key == QLatin1String("thp")) {
+        ok = value == QLatin1String("never") || value == QLatin1String("default");
+        mDisableThp = value == QLatin1String("never");
+    }
+    return ok;
+}
+
+bool LaunchPolicy::isEmpty() const
+{
+    return !mHasAffinity && mSchedPolicy < 0 && !mHasNice && !mHasOomScoreAdj
+            && !mHasMemlock && !mDisableThp;
+}
+
+void LaunchPolicy::applyInChild() const
+{
+    if (mHasAffinity && sched_setaffinity(0, sizeof(mAffinity), &mAffinity) != 0)
+        childError("AppController: Could not set CPU affinity\n");
+
+    if (mSchedPolicy >= 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        if (mSchedPolicy == SCHED_FIFO || mSchedPolicy == SCHED_RR)
+            param.sched_priority = mSchedPriority > 0 ? mSchedPriority : 1;
+        if (sched_setscheduler(0, mSchedPolicy, &param) != 0)
+            childError("AppController: Could not set scheduling policy\n");
+    }
+
+    if (mHasNice && setpriority(PRIO_PROCESS, 0, mNice) != 0)
+        childError("AppController: Could not set nice value\n");
+
+    if (mHasOomScoreAdj) {
+        const int fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+        const ssize_t size = strlen(mOomScoreAdj);
+        if (fd < 0 || write(fd, mOomScoreAdj, size) != size)
+            childError("AppController: Could not set oom_score_adj\n");
+        if (fd >= 0)
+            close(fd);
+    }
+
+    if (mHasMemlock) {
+        struct rlimit limit;
+        limit.rlim_cur = limit.rlim_max = mMemlock;
+        if (setrlimit(RLIMIT_MEMLOCK, &limit) != 0)
+            childError("AppController: Could not set RLIMIT_MEMLOCK\n");
+    }
+
+    if (mDisableThp && prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) != 0)
+        childError("AppController: Could not disable transparent huge pages\n");
+}
@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef LAUNCHPOLICY_H
+#define LAUNCHPOLICY_H
+
+#include <QString>
+#include <sched.h>
+#include <sys/resource.h>
+
+// Scheduling and memory policies applied to the child between fork and exec. All of
+// them are inherited over exec and fork, so they also reach the application when it
+// is started by gdbserver or perf.
+//
+// Settings are "<key>=<value>":
+//   affinity=<cpu list>        e.g. 0-1,3
+//   schedPolicy=<policy>       other, batch, idle, fifo or rr
+//   schedPriority=<1-99>       for fifo and rr
+//   nice=<-20-19>
+//   oomScoreAdj=<-1000-1000>
+//   memlock=<bytes>|unlimited  RLIMIT_MEMLOCK, mlockall() does not survive exec, so the
+//                              application has to lock its memory itself
+//   thp=never|default          never disables transparent huge pages for the process
+class LaunchPolicy
+{
+public:
+    LaunchPolicy();
+
+    static bool isKey(const QString &setting);
+    bool set(const QString &setting);
+    bool isEmpty() const;
+
+    // Only uses async-signal-safe functions
+    void applyInChild() const;
+
+private:
+    bool mHasAffinity;
+    cpu_set_t mAffinity;
+    int mSchedPolicy;
+    int mSchedPriority;
+    bool mHasNice;
+    int mNice;
+    bool mHasOomScoreAdj;
+    char mOomScoreAdj[8];
+    bool mHasMemlock;
+    rlim_t mMemlock;
+    bool mDisableThp;
+};
+
+#endif // LAUNCHPOLICY_H
@@ -0,0 +1,137 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "launchtrace.h"
+#include <QString>
+#include <QFile>
+#include <QFileInfo>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+
+namespace {
+
+struct Event {
+    LaunchTrace::Phase phase;
+    qint64 start;    // us
+    qint64 duration; // us, -1 for instant events and phases that did not end
+    bool instant;
+};
+
+const char * const phaseNames[] = {
+    "startup",
+    "config parse",
+    "port probing",
+    "server socket",
+    "daemonize",
+    "environment",
+    "warmup",
+    "fork/exec",
+    "first stdout byte",
+    "first stderr byte",
+    "exit"
+};
+
+const int MaxEvents = 64;
+Event events[MaxEvents];
+int eventCount = 0;
+QString outputFile;
+
+qint64 now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+Event *append(LaunchTrace::Phase phase, bool instant)
+{
+    if (eventCount == MaxEvents)
+        return 0;
+    Event *event = &events[eventCount++];
+    event->phase = phase;
+    event->start = now();
+    event->duration = -1;
+    event->instant = instant;
+    return event;
+}
+
+} // anonymous namespace
+
+namespace LaunchTrace {
+
+void begin(Phase phase)
+{
+    append(phase, false);
+}
+
+void end(Phase phase)
+{
+    const qint64 timestamp = now();
+    for (int i = eventCount - 1; i >= 0; --i) {
+        if (events[i].phase == phase && !events[i].instant && events[i].duration < 0) {
+            events[i].duration = timestamp - events[i].start;
+            return;
+        }
+    }
+}
+
+void mark(Phase phase)
+{
+    append(phase, true);
+}
+
+void setOutputFile(const QString &fileName)
+{
+    // --detach changes the working directory
+    outputFile = QFileInfo(fileName).absoluteFilePath();
+}
+
+bool write()
+{
+    if (outputFile.isEmpty())
+        return true;
+
+    QFile f(outputFile);
+    if (!f.open(QFile::WriteOnly | QFile::Truncate)) {
+        fprintf(stderr, "Could not write launch trace to %s\n", qPrintable(outputFile));
+        return false;
+    }
+
+    const int pid = getpid();
+    f.write("{\"traceEvents\":[\n");
+    for (int i = 0; i < eventCount; ++i) {
+        const Event &event = events[i];
+        char line[256];
+        if (event.instant || event.duration < 0) {
+            snprintf(line, sizeof(line),
+                     "{\"name\":\"%s\",\"cat\":\"launch\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%lld,\"pid\":%d,\"tid\":%d}%s\n",
+                     phaseNames[event.phase], event.start, pid, pid, i + 1 < eventCount ? "," : "");
+        } else {
+            snprintf(line, sizeof(line),
+                     "{\"name\":\"%s\",\"cat\":\"launch\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d}%s\n",
+                     phaseNames[event.phase], event.start, event.duration, pid, pid,
+                     i + 1 < eventCount ? "," : "");
+        }
+        f.write(line);
+    }
+    f.write("],\"displayTimeUnit\":\"ms\"}\n");
+    return true;
+}
+
+} // namespace LaunchTrace
@@ -0,0 +1,51 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef LAUNCHTRACE_H
+#define LAUNCHTRACE_H
+
+class QString;
+
+// Records CLOCK_MONOTONIC timestamps of the launch phases. Recording is always on and
+// only touches a static array; the Chrome trace JSON is written if an output file is set.
+namespace LaunchTrace {
+
+enum Phase {
+    Startup,
+    ConfigParse,
+    PortProbing,
+    ServerSocket,
+    Daemonize,
+    Environment,
+    Warmup,
+    ForkExec,
+    FirstStdoutByte,
+    FirstStderrByte,
+    Exit
+};
+
+void begin(Phase phase);
+void end(Phase phase);
+void mark(Phase phase);
+
+void setOutputFile(const QString &fileName);
+bool write();
+
+} // namespace LaunchTrace
+
+#endif // LAUNCHTRACE_H
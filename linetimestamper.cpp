@@ -0,0 +1,109 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "linetimestamper.h"
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int MaxPrefixSize = 64;
+
+LineTimestamper::LineTimestamper(const char *streamName)
+    : mStreamName(streamName)
+    , mMode(None)
+    , mAtLineStart(true)
+{
+}
+
+void LineTimestamper::setMode(Mode mode)
+{
+    mMode = mode;
+}
+
+LineTimestamper::Mode LineTimestamper::mode() const
+{
+    return mMode;
+}
+
+void LineTimestamper::reset()
+{
+    mAtLineStart = true;
+}
+
+int LineTimestamper::formatPrefix(char *prefix) const
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int size = mMode == TimeAndStream
+            ? snprintf(prefix, MaxPrefixSize, "[%5ld.%06ld] %s: ", long(now.tv_sec), now.tv_nsec / 1000, mStreamName)
+            : snprintf(prefix, MaxPrefixSize, "[%5ld.%06ld] ", long(now.tv_sec), now.tv_nsec / 1000);
+    return qMin(size, MaxPrefixSize - 1);
+}
+
+const QByteArray &LineTimestamper::process(const char *data, int size)
+{
+    // All lines of one read get the same time stamp, so it is formatted only once
+    char prefix[MaxPrefixSize];
+    const int prefixSize = formatPrefix(prefix);
+
+    int lines = mAtLineStart ? 1 : 0;
+    for (const char *pos = data, *end = data + size;
+         (pos = static_cast<const char *>(memchr(pos, '\n', end - pos))); ++pos)
+        ++lines;
+
+    // With reserved capacity resize() never shrinks the allocation, so this only
+    // allocates while the reads grow
+    const int maxSize = size + lines * prefixSize;
+    if (maxSize > mOutput.capacity())
+        mOutput.reserve(maxSize);
+    mOutput.resize(maxSize);
+    char *out = mOutput.data();
+
+    const char *pos = data;
+    const char *end = data + size;
+    while (pos < end) {
+        if (mAtLineStart) {
+            memcpy(out, prefix, prefixSize);
+            out += prefixSize;
+            mAtLineStart = false;
+        }
+        const char *newline = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        const char *lineEnd = newline ? newline + 1 : end;
+        memcpy(out, pos, lineEnd - pos);
+        out += lineEnd - pos;
+        pos = lineEnd;
+        if (newline)
+            mAtLineStart = true;
+    }
+
+    mOutput.resize(out - mOutput.constData());
+    return mOutput;
+}
+
+bool LineTimestamper::parseMode(const QString &name, Mode *mode)
+{
+    if (name == QLatin1String("none"))
+        *mode = None;
+    else if (name == QLatin1String("time"))
+        *mode = Time;
+    else if (name == QLatin1String("stream"))
+        *mode = TimeAndStream;
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef LINETIMESTAMPER_H
+#define LINETIMESTAMPER_H
+
+#include <QByteArray>
+#include <QString>
+
+// Prefixes every line of one output stream with the CLOCK_MONOTONIC time at which its
+// first byte was read, in the format of the kernel log: "[   12.345678] ", optionally
+// followed by the stream name. Lines may be split across reads, the prefix is inserted
+// when the first byte of a line arrives, so nothing is held back.
+class LineTimestamper
+{
+public:
+    enum Mode {
+        None,
+        Time,
+        TimeAndStream
+    };
+
+    explicit LineTimestamper(const char *streamName);
+
+    void setMode(Mode mode);
+    Mode mode() const;
+    void reset();
+
+    // Writes data with prefixes into output, reusing its allocation. The returned
+    // array stays valid until the next call.
+    const QByteArray &process(const char *data, int size);
+
+    static bool parseMode(const QString &name, Mode *mode);
+
+private:
+    int formatPrefix(char *prefix) const;
+
+    const char * const mStreamName;
+    Mode mMode;
+    bool mAtLineStart;
+    QByteArray mOutput;
+};
+
+#endif // LINETIMESTAMPER_H
@@ -0,0 +1,112 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "logserver.h"
+#include <QTcpSocket>
+#include <string.h>
+#include <stdio.h>
+
+static const int MaxPendingBytes = 1024 * 1024;
+static const int MinBacklogSize = 4096;
+
+LogServer::LogServer(int backlogSize, QObject *parent)
+    : QObject(parent)
+    , mRing(qMax(backlogSize, MinBacklogSize), '\0')
+    , mStart(0)
+    , mSize(0)
+    , mDropped(0)
+{
+    connect(&mServer, &QTcpServer::newConnection, this, &LogServer::acceptConnections);
+}
+
+LogServer::~LogServer()
+{
+    if (mDropped > 0)
+        printf("AppController: Dropped %d slow log subscribers\n", mDropped);
+}
+
+bool LogServer::listen(int socketDescriptor)
+{
+    return mServer.setSocketDescriptor(socketDescriptor);
+}
+
+void LogServer::append(const char *data, int size)
+{
+    const int capacity = mRing.size();
+    if (size >= capacity) {
+        // Only the tail fits
+        memcpy(mRing.data(), data + size - capacity, capacity);
+        mStart = 0;
+        mSize = capacity;
+    } else {
+        int end = (mStart + mSize) % capacity;
+        const int first = qMin(size, capacity - end);
+        memcpy(mRing.data() + end, data, first);
+        memcpy(mRing.data(), data + first, size - first);
+        mSize += size;
+        if (mSize > capacity) {
+            mStart = (mStart + mSize - capacity) % capacity;
+            mSize = capacity;
+        }
+    }
+
+    // Iterate over a copy, slow subscribers are removed on the way
+    const QList<QTcpSocket *> subscribers = mSubscribers;
+    foreach (QTcpSocket *subscriber, subscribers) {
+        if (subscriber->bytesToWrite() + size > MaxPendingBytes)
+            dropSubscriber(subscriber);
+        else
+            subscriber->write(data, size);
+    }
+}
+
+QByteArray LogServer::backlog() const
+{
+    const int capacity = mRing.size();
+    const int first = qMin(mSize, capacity - mStart);
+    QByteArray data(mRing.constData() + mStart, first);
+    data.append(mRing.constData(), mSize - first);
+    return data;
+}
+
+void LogServer::acceptConnections()
+{
+    while (QTcpSocket *subscriber = mServer.nextPendingConnection()) {
+        connect(subscriber, &QTcpSocket::disconnected, this, &LogServer::subscriberDisconnected);
+        subscriber->write(backlog());
+        mSubscribers.append(subscriber);
+    }
+}
+
+void LogServer::subscriberDisconnected()
+{
+    QTcpSocket *subscriber = qobject_cast<QTcpSocket *>(sender());
+    if (!subscriber)
+        return;
+    mSubscribers.removeOne(subscriber);
+    subscriber->deleteLater();
+}
+
+void LogServer::dropSubscriber(QTcpSocket *subscriber)
+{
+    ++mDropped;
+    mSubscribers.removeOne(subscriber);
+    disconnect(subscriber, 0, this, 0);
+    subscriber->abort();
+    subscriber->deleteLater();
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef LOGSERVER_H
+#define LOGSERVER_H
+
+#include <QTcpServer>
+#include <QByteArray>
+#include <QList>
+
+class QTcpSocket;
+
+// Streams the application output to any number of TCP subscribers. The most recent
+// output is kept in a fixed-size ring, so a subscriber that connects late first gets
+// that backlog. Subscribers are served from the event loop without ever blocking: one
+// that falls more than MaxPendingBytes behind is disconnected, so it can slow down
+// neither the application nor the other subscribers.
+class LogServer : public QObject
+{
+    Q_OBJECT
+public:
+    LogServer(int backlogSize, QObject *parent = 0);
+    ~LogServer();
+
+    // Adopts an already listening socket, see PortAllocator
+    bool listen(int socketDescriptor);
+
+    void append(const char *data, int size);
+
+private slots:
+    void acceptConnections();
+    void subscriberDisconnected();
+
+private:
+    QByteArray backlog() const;
+    void dropSubscriber(QTcpSocket *subscriber);
+
+    QTcpServer mServer;
+    QList<QTcpSocket *> mSubscribers;
+    QByteArray mRing;
+    int mStart;
+    int mSize;
+    int mDropped;
+};
+
+#endif // LOGSERVER_H
@@ -19,6 +19,15 @@
 #include "process.h"
 #include "portlist.h"
 #include "perfprocesshandler.h"
+#include "perfspool.h"
+#include "perfeventsampler.h"
+#include "controlprotocol.h"
+#include "daemon.h"
+#include "launchtrace.h"
+#include "portallocator.h"
+#include "framedoutput.h"
+#include "logserver.h"
+#include "gdbmultiserver.h"
 #include <QCoreApplication>
 #include <QTcpServer>
 #include <QProcess>
@@ -26,15 +35,32 @@
 #include <QStringList>
 #include <QSocketNotifier>
 #include <QFile>
+#include <QDir>
+#include <QStandardPaths>
+#include <QScopedPointer>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/time.h>
+#include <time.h>
 
 #define PID_FILE "/data/user/.appcontroller"
 
+#ifdef Q_OS_ANDROID
+    #define PORT_LEASE_FILE "/data/user/.appcontroller-ports"
+#else
+    #define PORT_LEASE_FILE "/tmp/.appcontroller-ports"
+#endif
+
+#ifdef Q_OS_ANDROID
+    #define GDBSERVER_DIRECTORY "/data/user/.appcontroller-gdbserver"
+#else
+    #define GDBSERVER_DIRECTORY "/tmp/.appcontroller-gdbserver"
+#endif
+
 #ifdef Q_OS_ANDROID
     #define B2QT_PREFIX "/data/user/b2qt"
 #else
@@ -43,14 +69,24 @@
 
 static int serverSocket = -1;
 
-static const char socketPath[] = "#Boot2Qt_appcontroller";
+static QString appSlot;
+static QByteArray controlSocketName = ControlProtocol::socketName();
+static const int ReplyTimeout = 10; // s for replies that don't wait for the application
+static const int TakeoverMargin = 5000; // ms on top of the time the application may take to stop
+static int takeoverTimeout = 0; // ms, derived from terminateTimeout and killTimeout
+static const int PerfDrainTimeout = 60000; // ms for a perf client to fetch the rest after exit
 
 static void usage()
 {
-    printf("appcontroller [--debug-gdb] [--debug-qml] [--port-range <range>] [--stop] [--launch] [--show-platfrom] [--make-default] [--remove-default] [--print-debug] [--version] [--detach] [executable] [arguments]\n"
+    printf("appcontroller [--debug-gdb] [--debug-gdb-multi] [--stop-gdbserver] [--debug-qml] [--port-range <range>] [--stop] [--launch] [--show-platfrom] [--make-default] [--remove-default] [--print-debug] [--version] [--detach] [--output-buffer <bytes>] [--output-policy <policy>] [--timestamps <mode>] [--sample-resources <ms>] [--resource-file <file>] [--cgroup <path>] [--cgroup-limit <file>=<value>] [--policy <key>=<value>] [--warmup <mode>] [--perf-snapshot <size>] [--attach-perf <parameters>] [--perf-duration <s>] [--perf-buffer <bytes>] [--perf-spill-file <file>] [--trace-launch <file>] [--daemon] [--use-daemon] [--slot <name>] [--framed-output] [--log-server] [executable] [arguments]\n"
            "\n"
            "--port-range <range> Port range to use for debugging connections\n"
            "--debug-gdb          Start GDB debugging\n"
+           "--debug-gdb-multi    Start GDB debugging through one gdbserver --multi that is kept running\n"
+           "                     for later launches on the same port. Connect with \"target extended-remote\"\n"
+           "                     once, the application is stopped before exec and its pid printed to\n"
+           "                     \"attach\" to\n"
+           "--stop-gdbserver     Stop the gdbserver kept running by --debug-gdb-multi\n"
            "--debug-qml          Start QML debugging\n"
            "--stop               Stop already running application\n"
            "--launch             Start application without stopping already running application\n"
@@ -60,42 +96,125 @@ static void usage()
            "--print-debug        Print debug messages to stdout on Android\n"
            "--version            Print version information\n"
            "--detach             Start application as usual, then go into background\n"
+           "--output-buffer <bytes> Buffer application output and write it from a separate thread\n"
+           "--output-policy <policy> What to do when the output buffer is full: block, drop-oldest or drop-newest\n"
+           "--timestamps <mode>  Prefix output lines with the monotonic time: none, time or stream\n"
+           "--sample-resources <ms> Sample memory, CPU, threads, fds and I/O of the application tree\n"
+           "--resource-file <file> Write the resource samples to file, otherwise only print a summary\n"
+           "--cgroup <path>      Run each launch in its own cgroup v2 below path\n"
+           "--cgroup-limit <file>=<value> Set cpu.max, cpu.weight, memory.max, memory.high or io.weight\n"
+           "                     of that cgroup, may be repeated\n"
+           "--policy <key>=<value> Apply a scheduling or memory policy to the application, may be\n"
+           "                     repeated. Keys: affinity=<cpu list>, schedPolicy=<other|batch|idle|fifo|rr>,\n"
+           "                     schedPriority=<1-99>, nice=<n>, oomScoreAdj=<n>, memlock=<bytes|unlimited>,\n"
+           "                     thp=<never|default>\n"
+           "--warmup <mode>      Read the binary and its libraries into the page cache before starting\n"
+           "                     it: none, readahead or lock (keep them locked while it runs)\n"
+           "--perf-snapshot <size> With --profile-perf, start right away and let perf record into a\n"
+           "                     ring buffer of size per CPU. Every connection to the perf port\n"
+           "                     receives the current contents, the most recent samples.\n"
+           "--attach-perf <parameters> Profile the running application with \"perf record -p\" and\n"
+           "                     the comma-separated parameters, streamed over the perf port\n"
+           "--perf-duration <s>  How long --attach-perf records, 10 s by default\n"
+           "--perf-buffer <bytes> Keep this much of the perf stream, so that recording continues when\n"
+           "                     the connection drops and a reconnecting client can resume\n"
+           "--perf-spill-file <file> Keep the --perf-buffer in file (e.g. on tmpfs) instead of memory\n"
+           "--trace-launch <file> Write timestamps of the launch phases to file (Chrome trace format)\n"
+           "--daemon             Stay resident and serve launch requests from --use-daemon\n"
+           "--use-daemon         Launch or --stop the application through the resident daemon\n"
+           "--slot <name>        Run the application in a named slot, independent of other slots.\n"
+           "                     Must precede --stop. With --use-daemon the slot is opened on demand\n"
+           "--framed-output      Multiplex application output and controller messages into frames\n"
+           "                     with stream id and timestamp on stdout, see framedoutput.h\n"
+           "--log-server         Stream the application output to TCP clients on a port from --port-range,\n"
+           "                     late clients get the recent output first. Also works with --detach,\n"
+           "                     but not with --profile-perf\n"
            "--help, -h, -help    Show this help\n"
           );
 }
 
-static void setupAddressStruct(struct sockaddr_un &address)
+static int openSocket(const QByteArray &name = controlSocketName)
 {
-    address.sun_family = AF_UNIX;
-    memset(address.sun_path, 0, sizeof(address.sun_path));
-    strncpy(address.sun_path, socketPath, sizeof(address.sun_path)-1);
-    address.sun_path[0] = 0;
+  int create_socket = ControlProtocol::connectSocket(name);
+  if (create_socket < 0)
+    perror("Could not connect");
+  return create_socket;
 }
 
-static int connectSocket()
+// Asks the running instance to stop its application and to exit. Returns 0 once the
+// application has exited and the control socket has been released, -1 if there is no
+// instance to connect to and 1 if it did not stop in time.
+static int stopRunningInstance()
 {
-  int create_socket;
-  struct sockaddr_un address;
-
-  if ((create_socket = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
-      perror("Could not create socket");
+  int create_socket = openSocket();
+  if (create_socket < 0)
       return -1;
-  }
 
-  if (fcntl(create_socket, F_SETFD, FD_CLOEXEC) == -1) {
-      perror("Unable to set CLOEXEC");
-  }
+  // The instance may need its whole terminate and kill timeouts, waiting on this one
+  // connection is enough, sending EXIT again would not speed it up
+  struct timeval timeout;
+  timeout.tv_sec = takeoverTimeout / 1000;
+  timeout.tv_usec = (takeoverTimeout % 1000) * 1000;
+  setsockopt(create_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
-  setupAddressStruct(address);
+  ControlProtocol::sendCommand(create_socket, "EXIT", QStringList());
 
-  if (connect(create_socket, (struct sockaddr *) &address, sizeof (address)) != 0) {
-    perror("Could not connect");
-    return -1;
+  // Instances that don't reply keep the connection open until they are gone,
+  // so EOF means the same as "STOPPED".
+  QByteArray buffer;
+  QByteArray reply;
+  forever {
+      errno = 0;
+      if (!ControlProtocol::readReply(create_socket, &buffer, &reply)) {
+          if (errno == EAGAIN || errno == EWOULDBLOCK) {
+              fprintf(stderr, "AppController: Running instance did not stop within %d ms\n",
+                      takeoverTimeout);
+              close(create_socket);
+              return 1;
+          }
+          break;
+      }
+      if (reply == "STOPPED")
+          break;
   }
   close(create_socket);
   return 0;
 }
 
+// Asks the running instance for the processes of its application, "" if there are none
+static QString queryApplicationPids()
+{
+  int fd = openSocket();
+  if (fd < 0) {
+      fprintf(stderr, "No application is running\n");
+      return QString();
+  }
+
+  struct timeval timeout;
+  timeout.tv_sec = ReplyTimeout;
+  timeout.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  QByteArray buffer;
+  QByteArray reply;
+  const bool ok = ControlProtocol::sendCommand(fd, "PIDS", QStringList())
+          && ControlProtocol::readReply(fd, &buffer, &reply);
+  close(fd);
+  if (!ok || !reply.startsWith("PIDS ")) {
+      fprintf(stderr, "Could not find the application's processes: %s\n",
+              ok ? reply.constData() : "no reply");
+      return QString();
+  }
+  return QString::fromLatin1(reply.mid(5));
+}
+
+static qint64 elapsedMs(const struct timespec &start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+}
+
 static int createServerSocket()
 {
   struct sockaddr_un address;
@@ -109,8 +228,11 @@ static int createServerSocket()
       perror("Unable to set CLOEXEC");
   }
 
-  setupAddressStruct(address);
+  ControlProtocol::setupAddress(&address, controlSocketName);
 
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  bool tookOver = false;
   unsigned int tries = 20;
 
   while (tries > 0) {
@@ -121,11 +243,15 @@ static int createServerSocket()
               return -1;
           }
 
-          if (connectSocket() != 0) {
+          const int stopped = stopRunningInstance();
+          if (stopped > 0)
+              return -1;
+          if (stopped < 0) {
+              // The other instance is between bind() and listen()
               fprintf(stderr, "Failed to connect to process\n");
+              usleep(50000);
           }
-
-          usleep(500000);
+          tookOver = true;
           continue;
       }
 
@@ -133,8 +259,10 @@ static int createServerSocket()
           perror("Could not listen");
           return -1;
       }
-      else
-          return 0;
+
+      if (tookOver)
+          printf("AppController: Stopped previous instance in %lld ms\n", elapsedMs(start));
+      return 0;
   }
 
   return -1;
@@ -142,22 +270,69 @@ static int createServerSocket()
 
 static void stop()
 {
-    connectSocket();
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (stopRunningInstance() == 0)
+        printf("AppController: Stopped running instance in %lld ms\n", elapsedMs(start));
 }
 
-static int openServer(QTcpServer *s, Utils::PortList &range)
+// Opens the named slot in the daemon, unless it is already open
+static bool openDaemonSlot()
 {
-    while (range.hasMore()) {
-        if (s->listen(QHostAddress::Any, range.getNext()))
-            return s->serverPort();
-    }
-    return -1;
+    int fd = openSocket(ControlProtocol::socketName());
+    if (fd < 0)
+        return false;
+
+    QByteArray buffer;
+    QByteArray reply;
+    const bool ok = ControlProtocol::sendCommand(fd, "SLOT", QStringList() << appSlot)
+            && ControlProtocol::readReply(fd, &buffer, &reply) && reply == "OK";
+    if (!ok && reply.startsWith("ERROR "))
+        fprintf(stderr, "%s\n", reply.mid(6).constData());
+    close(fd);
+    return ok;
 }
 
-static int findFirstFreePort(Utils::PortList &range)
+static int sendToDaemon(const QByteArray &command, const QStringList &args, const QVector<int> &fds)
 {
-    QTcpServer s;
-    return openServer(&s, range);
+    int fd = ControlProtocol::connectSocket(controlSocketName);
+    if (fd < 0 && !appSlot.isEmpty() && command == "LAUNCH" && openDaemonSlot())
+        fd = ControlProtocol::connectSocket(controlSocketName);
+    if (fd < 0) {
+        fprintf(stderr, "No appcontroller daemon running\n");
+        return 1;
+    }
+
+    if (!ControlProtocol::sendCommand(fd, command, args, fds)) {
+        perror("Could not send command to daemon");
+        close(fd);
+        return 1;
+    }
+
+    // The application output goes directly to our stdout and stderr, we only wait for the result
+    int rc = 1;
+    QByteArray buffer;
+    QByteArray reply;
+    while (ControlProtocol::readReply(fd, &buffer, &reply)) {
+        if (reply == "OK") {
+            rc = 0;
+            break;
+        } else if (reply.startsWith("EXITED ")) {
+            const int exitCode = reply.mid(7).toInt();
+            if (exitCode >= 0) {
+                printf("Process exited with exit code %d\n", exitCode);
+                rc = exitCode;
+            } else {
+                printf("Process stopped\n");
+            }
+            break;
+        } else if (reply.startsWith("ERROR ")) {
+            fprintf(stderr, "%s\n", reply.mid(6).constData());
+            break;
+        }
+    }
+    close(fd);
+    return rc;
 }
 
 static Config parseConfigFile()
@@ -192,6 +367,67 @@ static Config parseConfigFile()
               config.base = line.mid(5).simplified();
         } else if (line.startsWith("platform=")) {
               config.platform = line.mid(9).simplified();
+        } else if (line.startsWith("terminateTimeout=")) {
+              bool ok;
+              const int value = line.mid(17).simplified().toInt(&ok);
+              if (ok && value >= 0)
+                  config.terminateTimeout = value;
+              else
+                  qWarning() << "Invalid value for terminateTimeout:" << line.mid(17).simplified();
+        } else if (line.startsWith("killTimeout=")) {
+              bool ok;
+              const int value = line.mid(12).simplified().toInt(&ok);
+              if (ok && value >= 0)
+                  config.killTimeout = value;
+              else
+                  qWarning() << "Invalid value for killTimeout:" << line.mid(12).simplified();
+        } else if (line.startsWith("outputBuffer=")) {
+              bool ok;
+              const int value = line.mid(13).simplified().toInt(&ok);
+              if (ok && value >= 0)
+                  config.outputBufferSize = value;
+              else
+                  qWarning() << "Invalid value for outputBuffer:" << line.mid(13).simplified();
+        } else if (line.startsWith("outputPolicy=")) {
+              const QString value = line.mid(13).simplified();
+              if (!OutputPipeline::parsePolicy(value, &config.outputPolicy))
+                  qWarning() << "Unknown value for outputPolicy:" << value;
+        } else if (line.startsWith("timestamps=")) {
+              const QString value = line.mid(11).simplified();
+              if (!LineTimestamper::parseMode(value, &config.timestamps))
+                  qWarning() << "Unknown value for timestamps:" << value;
+        } else if (line.startsWith("logBacklog=")) {
+              bool ok;
+              const int value = line.mid(11).simplified().toInt(&ok);
+              if (ok && value >= 0)
+                  config.logBacklogSize = value;
+              else
+                  qWarning() << "Invalid value for logBacklog:" << line.mid(11).simplified();
+        } else if (line.startsWith("resourceInterval=")) {
+              bool ok;
+              const int value = line.mid(17).simplified().toInt(&ok);
+              if (ok && value >= 0)
+                  config.resourceInterval = value;
+              else
+                  qWarning() << "Invalid value for resourceInterval:" << line.mid(17).simplified();
+        } else if (line.startsWith("resourceFile=")) {
+              config.resourceFile = line.mid(13).simplified();
+        } else if (line.startsWith("cgroup=")) {
+              config.cgroupParent = line.mid(7).simplified();
+        } else if (line.startsWith("cgroupLimit=")) {
+              const QString value = line.mid(12).simplified();
+              if (Cgroup::isValidLimit(value))
+                  config.cgroupLimits += value;
+              else
+                  qWarning() << "Invalid value for cgroupLimit:" << value;
+        } else if (line.startsWith("warmup=")) {
+              if (!PageCacheWarmup::parseMode(line.mid(7).simplified(), &config.warmup))
+                  qWarning() << "Invalid value for warmup:" << line.mid(7).simplified();
+        } else if (LaunchPolicy::isKey(line)) {
+              if (!config.launchPolicy.set(line.simplified()))
+                  qWarning() << "Invalid launch policy:" << line.simplified();
+        } else if (line.startsWith("traceLaunch=")) {
+              LaunchTrace::setOutputFile(line.mid(12).simplified());
         } else if (line.startsWith("debugInterface=")) {
               const QString value = line.mid(15).simplified();
               if (value == "local")
@@ -264,6 +500,8 @@ static QStringList extractPerfParams(QString s)
 
 int main(int argc, char **argv)
 {
+    LaunchTrace::mark(LaunchTrace::Startup);
+
     // Save arguments before QCoreApplication handles them
     QStringList args;
     for (int i = 1; i < argc; i++)
@@ -272,10 +510,21 @@ int main(int argc, char **argv)
     QStringList defaultArgs;
     quint16 gdbDebugPort = 0;
     bool useGDB = false;
+    bool useGdbMulti = false;
     bool useQML = false;
     QStringList perfParams;
+    QString perfSnapshotSize;
+    qint64 perfBufferSize = 0;
+    QString perfSpillFile;
+    bool attachPerf = false;
+    int perfDuration = 10; // s
+    QString attachPids;
     bool fireAndForget = false;
     bool detach = false;
+    bool daemonMode = false;
+    bool useDaemon = false;
+    bool framedOutput = false;
+    bool logServer = false;
     Utils::PortList range;
 
     if (args.isEmpty()) {
@@ -283,7 +532,10 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    LaunchTrace::begin(LaunchTrace::ConfigParse);
     Config config = parseConfigFile();
+    takeoverTimeout = config.terminateTimeout + config.killTimeout + TakeoverMargin;
+    LaunchTrace::end(LaunchTrace::ConfigParse);
 
     while (!args.isEmpty()) {
         const QString arg(args.takeFirst());
@@ -298,6 +550,11 @@ int main(int argc, char **argv)
                 fprintf(stderr, "Invalid port range\n");
                 return 1;
             }
+        } else if (arg == "--debug-gdb-multi") {
+            useGdbMulti = true;
+        } else if (arg == "--stop-gdbserver") {
+            GdbMultiServer(QLatin1String(GDBSERVER_DIRECTORY)).stop();
+            return 0;
         } else if (arg == "--debug-gdb") {
             useGDB = true;
             setpgid(0,0); // must be called before setsid()
@@ -313,7 +570,46 @@ int main(int argc, char **argv)
                 return 1;
             }
             perfParams = extractPerfParams(args.takeFirst());
+        } else if (arg == "--attach-perf") {
+            if (args.isEmpty()) {
+                fprintf(stderr, "--attach-perf requires comma-separated list of parameters that "
+                                "get passed to \"perf record\", as --profile-perf\n");
+                return 1;
+            }
+            perfParams = extractPerfParams(args.takeFirst());
+            attachPerf = true;
+        } else if (arg == "--perf-duration") {
+            bool ok = false;
+            if (!args.isEmpty())
+                perfDuration = args.takeFirst().toInt(&ok);
+            if (!ok || perfDuration <= 0) {
+                fprintf(stderr, "--perf-duration requires a number of seconds\n");
+                return 1;
+            }
+        } else if (arg == "--perf-buffer") {
+            bool ok = false;
+            if (!args.isEmpty())
+                perfBufferSize = args.takeFirst().toLongLong(&ok);
+            if (!ok || perfBufferSize <= 0) {
+                fprintf(stderr, "--perf-buffer requires a size in bytes\n");
+                return 1;
+            }
+        } else if (arg == "--perf-spill-file") {
+            if (args.isEmpty()) {
+                fprintf(stderr, "--perf-spill-file requires a file name\n");
+                return 1;
+            }
+            perfSpillFile = args.takeFirst();
+        } else if (arg == "--perf-snapshot") {
+            if (args.isEmpty()) {
+                fprintf(stderr, "--perf-snapshot requires the size of the ring buffer per CPU, "
+                                "as passed to \"perf record -m\"\n");
+                return 1;
+            }
+            perfSnapshotSize = args.takeFirst();
         } else if (arg == "--stop") {
+            if (useDaemon)
+                return sendToDaemon("STOP", QStringList(), QVector<int>());
             stop();
             return 0;
         } else if (arg == "--launch") {
@@ -343,6 +639,85 @@ int main(int argc, char **argv)
             return 0;
         } else if (arg == "--detach") {
             detach = true;
+        } else if (arg == "--output-buffer") {
+            bool ok = false;
+            if (!args.isEmpty())
+                config.outputBufferSize = args.takeFirst().toInt(&ok);
+            if (!ok || config.outputBufferSize < 0) {
+                fprintf(stderr, "--output-buffer requires a size in bytes\n");
+                return 1;
+            }
+        } else if (arg == "--output-policy") {
+            if (args.isEmpty() || !OutputPipeline::parsePolicy(args.takeFirst(), &config.outputPolicy)) {
+                fprintf(stderr, "--output-policy requires one of block, drop-oldest, drop-newest\n");
+                return 1;
+            }
+        } else if (arg == "--timestamps") {
+            if (args.isEmpty() || !LineTimestamper::parseMode(args.takeFirst(), &config.timestamps)) {
+                fprintf(stderr, "--timestamps requires one of none, time, stream\n");
+                return 1;
+            }
+        } else if (arg == "--sample-resources") {
+            bool ok = false;
+            if (!args.isEmpty())
+                config.resourceInterval = args.takeFirst().toInt(&ok);
+            if (!ok || config.resourceInterval <= 0) {
+                fprintf(stderr, "--sample-resources requires an interval in ms\n");
+                return 1;
+            }
+        } else if (arg == "--resource-file") {
+            if (args.isEmpty()) {
+                fprintf(stderr, "--resource-file requires a file name\n");
+                return 1;
+            }
+            config.resourceFile = args.takeFirst();
+        } else if (arg == "--cgroup") {
+            if (args.isEmpty()) {
+                fprintf(stderr, "--cgroup requires the path of the parent cgroup\n");
+                return 1;
+            }
+            config.cgroupParent = args.takeFirst();
+        } else if (arg == "--cgroup-limit") {
+            if (args.isEmpty() || !Cgroup::isValidLimit(args.first())) {
+                fprintf(stderr, "--cgroup-limit requires <file>=<value> with one of cpu.max, cpu.weight, "
+                                "memory.max, memory.high, io.weight\n");
+                return 1;
+            }
+            config.cgroupLimits += args.takeFirst();
+        } else if (arg == "--warmup") {
+            if (args.isEmpty() || !PageCacheWarmup::parseMode(args.first(), &config.warmup)) {
+                fprintf(stderr, "--warmup requires one of none, readahead, lock\n");
+                return 1;
+            }
+            args.removeFirst();
+        } else if (arg == "--policy") {
+            if (args.isEmpty() || !LaunchPolicy::isKey(args.first())
+                    || !config.launchPolicy.set(args.first())) {
+                fprintf(stderr, "--policy requires a valid <key>=<value>, see --help\n");
+                return 1;
+            }
+            args.removeFirst();
+        } else if (arg == "--trace-launch") {
+            if (args.isEmpty()) {
+                fprintf(stderr, "--trace-launch requires a file name\n");
+                return 1;
+            }
+            LaunchTrace::setOutputFile(args.takeFirst());
+        } else if (arg == "--slot") {
+            if (args.isEmpty() || !ControlProtocol::isValidSlotName(args.first())) {
+                fprintf(stderr, "--slot requires a name made of letters, digits, '-' and '_'\n");
+                return 1;
+            }
+            appSlot = args.takeFirst();
+            controlSocketName = ControlProtocol::socketName(appSlot);
+        } else if (arg == "--log-server") {
+            logServer = true;
+        } else if (arg == "--framed-output") {
+            framedOutput = true;
+        } else if (arg == "--daemon") {
+            daemonMode = true;
+        } else if (arg == "--use-daemon") {
+            useDaemon = true;
         } else if (arg == "--help" || arg == "-help" || arg == "-h") {
             usage();
             return 0;
@@ -352,67 +727,192 @@ int main(int argc, char **argv)
         }
     }
 
-    if (args.isEmpty()) {
+    if (attachPerf) {
+        if (!args.isEmpty() || useGDB || useGdbMulti || useQML || fireAndForget || detach || daemonMode || useDaemon
+                || logServer || framedOutput || !perfSnapshotSize.isEmpty()) {
+            fprintf(stderr, "--attach-perf does not take an application or launch options.\n");
+            return 1;
+        }
+        attachPids = queryApplicationPids();
+        if (attachPids.isEmpty())
+            return 1;
+    } else if (daemonMode) {
+        if (!args.isEmpty() || useGDB || useGdbMulti || useQML || !perfParams.isEmpty() || fireAndForget || useDaemon
+                || !appSlot.isEmpty() || logServer) {
+            fprintf(stderr, "--daemon does not take an application or launch options.\n");
+            return 1;
+        }
+    } else if (args.isEmpty()) {
         fprintf(stderr, "No binary to execute.\n");
         return 1;
     }
 
-    if ((useGDB || useQML) && !range.hasMore()) {
+    if (!perfSnapshotSize.isEmpty() && perfParams.isEmpty()) {
+        fprintf(stderr, "--perf-snapshot requires --profile-perf\n");
+        return 1;
+    }
+    if (!perfSpillFile.isEmpty() && perfBufferSize == 0) {
+        fprintf(stderr, "--perf-spill-file requires --perf-buffer\n");
+        return 1;
+    }
+    if (perfBufferSize > 0 && (perfParams.isEmpty() || !perfSnapshotSize.isEmpty())) {
+        fprintf(stderr, "--perf-buffer requires --profile-perf or --attach-perf and is not possible with --perf-snapshot\n");
+        return 1;
+    }
+
+    // The application's stdout is the perf data stream, which must be neither touched nor
+    // dropped by the output buffer
+    if (!perfParams.isEmpty() && perfSnapshotSize.isEmpty()) {
+        config.timestamps = LineTimestamper::None;
+        config.outputBufferSize = 0;
+    }
+
+    if (framedOutput && (!perfParams.isEmpty() || detach || useDaemon || daemonMode)) {
+        fprintf(stderr, "--framed-output is not possible with --profile-perf, --detach, --daemon and --use-daemon.\n");
+        return 1;
+    }
+
+    // The perf data stream would end up in the text backlog of every log client
+    if (logServer && !perfParams.isEmpty()) {
+        fprintf(stderr, "--log-server is not possible with --profile-perf.\n");
+        return 1;
+    }
+
+    // Everything written to stdout from now on, including our own messages, is framed
+    QScopedPointer<FramedOutput> framed;
+    if (framedOutput) {
+        framed.reset(new FramedOutput(STDOUT_FILENO));
+        framed->captureControllerOutput();
+    }
+
+    if (useDaemon) {
+        if (useGDB || useGdbMulti || useQML || !perfParams.isEmpty() || detach || logServer) {
+            fprintf(stderr, "Debugging, profiling, --log-server and --detach are not possible with --use-daemon.\n");
+            return 1;
+        }
+        QVector<int> fds;
+        fds << STDOUT_FILENO << STDERR_FILENO;
+        return sendToDaemon("LAUNCH", args, fds);
+    }
+
+    if (useGdbMulti && (useGDB || !perfParams.isEmpty())) {
+        fprintf(stderr, "--debug-gdb-multi is not possible with --debug-gdb and --profile-perf.\n");
+        return 1;
+    }
+
+    const QString gdbInterface = config.debugInterface == Config::LocalDebugInterface
+            ? QLatin1String("localhost") : QString();
+
+    // A running gdbserver --multi is reused together with its port and the host's connection
+    GdbMultiServer gdbMultiServer(QLatin1String(GDBSERVER_DIRECTORY));
+    bool startGdbMultiServer = false;
+    if (useGdbMulti) {
+        if (gdbMultiServer.isRunning() && gdbMultiServer.interface() != gdbInterface)
+            gdbMultiServer.stop();
+        startGdbMultiServer = !gdbMultiServer.isRunning();
+    }
+
+    if ((useGDB || startGdbMultiServer || useQML || logServer) && !range.hasMore()) {
         fprintf(stderr, "--port-range is mandatory\n");
         return 1;
     }
 
-    if (detach && (useGDB || useQML)) {
+    if (detach && (useGDB || useGdbMulti || useQML)) {
         fprintf(stderr, "Detached debugging not possible. --detach and one of --useGDB, --useQML must not be used together.\n");
         return 1;
     }
 
+    // All ports are allocated in one pass and stay reserved until they are handed over
+    LaunchTrace::begin(LaunchTrace::PortProbing);
+    PortLeases portLeases(QLatin1String(PORT_LEASE_FILE));
+    PortAllocator portAllocator(range);
+    portAllocator.setLeases(&portLeases);
+    QVector<int> ports;
+    const int portCount = (useGDB || startGdbMultiServer ? 1 : 0) + (useQML ? 1 : 0) + (perfParams.isEmpty() ? 0 : 1)
+            + (logServer ? 1 : 0);
+    if (portCount > 0 && !portAllocator.allocate(portCount, &ports)) {
+        fprintf(stderr, "Could not find an unused port in range\n");
+        return 1;
+    }
+    QVector<int> reservedSockets;
     if (useGDB) {
-        int port = findFirstFreePort(range);
-        if (port < 0) {
-            fprintf(stderr, "Could not find an unused port in range\n");
+        gdbDebugPort = ports.takeFirst();
+        reservedSockets.append(portAllocator.takeReservation(gdbDebugPort));
+    }
+    if (startGdbMultiServer) {
+        // gdbserver binds the port itself and keeps it beyond this launch
+        const int port = ports.takeFirst();
+        ::close(portAllocator.takeSocket(port));
+        if (!gdbMultiServer.start(port, gdbInterface)) {
+            fprintf(stderr, "Could not start gdbserver: %s\n", qPrintable(gdbMultiServer.errorString()));
             return 1;
         }
-        gdbDebugPort = port;
     }
+    if (useGdbMulti)
+        printf("AppController: gdbserver --multi listening on port %d\n", gdbMultiServer.port());
     if (useQML) {
-        int port = findFirstFreePort(range);
-        if (port < 0) {
-            fprintf(stderr, "Could not find an unused port in range\n");
-            return 1;
-        }
+        int port = ports.takeFirst();
+        reservedSockets.append(portAllocator.takeReservation(port));
         defaultArgs.push_front("-qmljsdebugger=port:" + QString::number(port) + ",block");
         printf("QML Debugger: Going to wait for connection on port %d...\n", port);
     }
+    int perfPort = -1;
+    if (!perfParams.isEmpty())
+        perfPort = ports.takeFirst();
+    int logPort = -1;
+    if (logServer) {
+        // Printed before a --detach, so that the port is known
+        logPort = ports.takeFirst();
+        printf("AppController: Log server listening on port %d\n", logPort);
+    }
+    LaunchTrace::end(LaunchTrace::PortProbing);
 
-    defaultArgs.push_front(args.takeFirst());
-    defaultArgs.append(args);
+    QString applicationBinary;
+    if (!daemonMode && !attachPerf) {
+        applicationBinary = args.first();
+        defaultArgs.push_front(args.takeFirst());
+        defaultArgs.append(args);
+    }
 
     if (useGDB) {
-        QString interface;
-        if (config.debugInterface == Config::LocalDebugInterface)
-            interface = QLatin1String("localhost");
-
-        defaultArgs.push_front(interface + ":" + QString::number(gdbDebugPort));
+        defaultArgs.push_front(gdbInterface + ":" + QString::number(gdbDebugPort));
         defaultArgs.push_front("gdbserver");
     }
 
-    if (!fireAndForget && createServerSocket() != 0) {
+    LaunchTrace::begin(LaunchTrace::ServerSocket);
+    // Attaching leaves the control socket to the instance running the application
+    if (!fireAndForget && !attachPerf && createServerSocket() != 0) {
         fprintf(stderr, "Could not create serversocket\n");
         return 1;
     }
+    LaunchTrace::end(LaunchTrace::ServerSocket);
 
     // daemonize
     if (detach) {
+        LaunchTrace::begin(LaunchTrace::Daemonize);
+        // The port leases are recorded under our pid. The daemonized child adopts them
+        // before we exit, otherwise they would be dropped together with our pid.
+        const pid_t leaseOwner = getpid();
+        int leaseHandover[2];
+        if (pipe2(leaseHandover, O_CLOEXEC) != 0) {
+            perror("Could not create pipe");
+            return -1;
+        }
         pid_t rc = fork();
         if (rc == -1) {
             printf("fork failed\n");
             return -1;
         } else if (rc > 0) {
             // parent
+            ::close(leaseHandover[1]);
             ::wait(NULL); // wait for the child to exit
+            // EOF once the daemonized child adopted the leases or is gone
+            char c;
+            while (read(leaseHandover[0], &c, 1) < 0 && errno == EINTR) { }
+            portLeases.handOver();
             return 0;
         }
+        ::close(leaseHandover[0]);
 
         setsid();
         chdir("/");
@@ -432,37 +932,122 @@ int main(int argc, char **argv)
             return 0;
 
         // child
+        if (!portLeases.adopt(leaseOwner))
+            fprintf(stderr, "Could not take over the port leases\n");
+        ::close(leaseHandover[1]);
+        LaunchTrace::end(LaunchTrace::Daemonize);
     }
 
     // Create QCoreApplication after parameter parsing to prevent printing evaluation
     // message to terminal before QtCreator has parsed the output.
     QCoreApplication app(argc, argv);
+
+    if (daemonMode) {
+        // The daemon owns serverSocket from now on
+        Daemon daemon(serverSocket, config);
+        app.exec();
+        return 0;
+    }
+
     Process process;
     process.setConfig(config);
     if (gdbDebugPort)
         process.setDebug();
-    process.setSocketNotifier(new QSocketNotifier(serverSocket, QSocketNotifier::Read, &process));
+    process.setWaitForDebugger(useGdbMulti);
+    if (serverSocket >= 0)
+        process.setSocketNotifier(new QSocketNotifier(serverSocket, QSocketNotifier::Read, &process));
+    // gdbserver and the QML debugger bind their ports themselves, the reservations
+    // are released right before the application is started
+    process.setReservedSockets(reservedSockets);
+    process.setApplicationBinary(applicationBinary);
+    if (logServer) {
+        LogServer *server = new LogServer(config.logBacklogSize, &process);
+        // The application output is as private as the debugger
+        const bool loopback = config.debugInterface == Config::LocalDebugInterface;
+        if (!server->listen(portAllocator.takeSocket(logPort, loopback))) {
+            fprintf(stderr, "Could not listen on port %d\n", logPort);
+            return 1;
+        }
+        process.setLogServer(server);
+    }
+    if (framed) {
+        framed->watchControllerOutput();
+        process.setFramedOutput(framed.data());
+    }
 
+    PerfSpool *spool = 0;
     if (!perfParams.isEmpty()) {
+        // Fail before the host connects and perf is started
+        if (!attachPerf && !process.checkApplication())
+            return 1;
+
+        // Images without perf profile through the built-in sampler
+        const bool builtinSampler = QStandardPaths::findExecutable(QLatin1String("perf")).isEmpty();
+        if (builtinSampler && (attachPerf || !perfSnapshotSize.isEmpty() || perfBufferSize > 0)) {
+            fprintf(stderr, "--attach-perf, --perf-snapshot and --perf-buffer require perf, "
+                    "which is not installed\n");
+            return 1;
+        }
+
+        // Snapshots go to tmpfs and are removed once they are sent
+        const QString snapshotDirectory = QDir::tempPath() + QLatin1String("/appcontroller-perf-")
+                + QString::number(getpid());
         QStringList allArgs;
-        allArgs << QLatin1String("perf") << QLatin1String("record")
-                << perfParams << QLatin1String("-o") << QLatin1String("-")
-                << QLatin1String("--") << defaultArgs.join(QLatin1Char(' '));
+        allArgs << QLatin1String("perf") << QLatin1String("record") << perfParams;
+        if (builtinSampler) {
+            printf("AppController: perf is not installed, using the built-in sampler\n");
+            allArgs = defaultArgs;
+        } else if (perfSnapshotSize.isEmpty()) {
+            allArgs << QLatin1String("-o") << QLatin1String("-");
+        } else {
+            allArgs << QLatin1String("--overwrite") << QLatin1String("--switch-output")
+                    << QLatin1String("-m") << perfSnapshotSize
+                    << QLatin1String("-o") << snapshotDirectory + QLatin1String("/perf.data");
+        }
+        if (attachPerf) {
+            // perf stops recording when sleep exits, the application keeps running
+            allArgs << QLatin1String("-p") << attachPids << QLatin1String("--")
+                    << QLatin1String("sleep") << QString::number(perfDuration);
+        } else if (!builtinSampler) {
+            allArgs << QLatin1String("--") << defaultArgs.join(QLatin1Char(' '));
+        }
 
         PerfProcessHandler *server = new PerfProcessHandler(&process, allArgs);
-        int port = openServer(server->server(), range);
-        if (port < 0) {
-            fprintf(stderr, "Could not find an unused port in range\n");
+        if (!server->server()->setSocketDescriptor(portAllocator.takeSocket(perfPort))) {
+            fprintf(stderr, "Could not listen on port %d\n", perfPort);
             return 1;
         }
-        printf("AppController: Going to wait for perf connection on port %d...\n", port);
+        if (builtinSampler) {
+            PerfEventSampler *sampler = new PerfEventSampler(perfParams, &process);
+            process.setPerfEventSampler(sampler);
+            server->setEventSampler(sampler);
+        }
+        if (perfBufferSize > 0) {
+            spool = new PerfSpool(perfBufferSize, perfSpillFile, &process);
+            if (!spool->open())
+                return 1;
+            server->setSpool(spool);
+        }
+        if (perfSnapshotSize.isEmpty()) {
+            printf("AppController: Going to wait for perf connection on port %d...\n", perfPort);
+        } else {
+            if (!server->setSnapshotDirectory(snapshotDirectory)) {
+                fprintf(stderr, "Could not create %s\n", qPrintable(snapshotDirectory));
+                return 1;
+            }
+            printf("AppController: Perf snapshots available on port %d\n", perfPort);
+            process.start(allArgs);
+        }
     } else {
         process.start(defaultArgs);
     }
 
     app.exec();
-    if (!fireAndForget)
-        close(serverSocket);
+    LaunchTrace::mark(LaunchTrace::Exit);
+    if (spool)
+        spool->finish(PerfDrainTimeout);
+    LaunchTrace::write();
+    framed.reset();
     return 0;
 }
 
@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "outputforwarder.h"
+#include <QSocketNotifier>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+
+static const int BufferSize = 64 * 1024;
+
+OutputForwarder::OutputForwarder(QObject *parent)
+    : QObject(parent)
+    , mBuffer(BufferSize, Qt::Uninitialized)
+{
+    for (int i = 0; i < ChannelCount; ++i) {
+        mReadFd[i] = -1;
+        mWriteFd[i] = -1;
+        mCanSplice[i] = true;
+        mNotifier[i] = 0;
+    }
+}
+
+OutputForwarder::~OutputForwarder()
+{
+    close();
+}
+
+bool OutputForwarder::open()
+{
+    close();
+    for (int i = 0; i < ChannelCount; ++i) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            perror("Could not create output pipe");
+            close();
+            return false;
+        }
+        // Only our end is non-blocking, the application keeps a blocking stdout.
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        mReadFd[i] = fds[0];
+        mWriteFd[i] = fds[1];
+    }
+    return true;
+}
+
+// Called in the child between fork() and exec(). Only async-signal-safe calls are allowed here.
+void OutputForwarder::setupChildProcess()
+{
+    if (mWriteFd[StandardOutput] >= 0)
+        dup2(mWriteFd[StandardOutput], STDOUT_FILENO);
+    if (mWriteFd[StandardError] >= 0)
+        dup2(mWriteFd[StandardError], STDERR_FILENO);
+}
+
+void OutputForwarder::childStarted()
+{
+    for (int i = 0; i < ChannelCount; ++i) {
+        if (mWriteFd[i] >= 0) {
+            ::close(mWriteFd[i]);
+            mWriteFd[i] = -1;
+        }
+        if (mReadFd[i] >= 0 && !mNotifier[i]) {
+            mNotifier[i] = new QSocketNotifier(mReadFd[i], QSocketNotifier::Read, this);
+            connect(mNotifier[i], &QSocketNotifier::activated, this, &OutputForwarder::activated);
+        }
+    }
+}
+
+void OutputForwarder::close()
+{
+    for (int i = 0; i < ChannelCount; ++i) {
+        closeChannel(static_cast<Channel>(i));
+        if (mWriteFd[i] >= 0) {
+            ::close(mWriteFd[i]);
+            mWriteFd[i] = -1;
+        }
+    }
+}
+
+bool OutputForwarder::isOpen(Channel channel) const
+{
+    return mReadFd[channel] >= 0;
+}
+
+bool OutputForwarder::canSplice(Channel channel) const
+{
+    return mCanSplice[channel];
+}
+
+int OutputForwarder::bytesAvailable(Channel channel) const
+{
+    int available = 0;
+    if (mReadFd[channel] < 0 || ioctl(mReadFd[channel], FIONREAD, &available) != 0)
+        return 0;
+    return available;
+}
+
+// Moves everything currently buffered in the pipe to fd without copying it through user space.
+// Returns the number of bytes moved, 0 if there was nothing to move and -1 on error with errno
+// set. EAGAIN means that fd is not writable; EINVAL means that splice() is not supported for
+// fd and read() has to be used from now on.
+qint64 OutputForwarder::splice(Channel channel, int fd)
+{
+    if (mReadFd[channel] < 0)
+        return 0;
+
+    const int available = bytesAvailable(channel);
+    const ssize_t moved = ::splice(mReadFd[channel], NULL, fd, NULL,
+                                   available > 0 ? available : BufferSize,
+                                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved > 0)
+        return moved;
+
+    if (moved == 0) {
+        closeChannel(channel);
+        return 0;
+    }
+
+    const int error = errno;
+    if ((error == EAGAIN || error == EWOULDBLOCK) && available == 0)
+        return 0;
+    if (error == EINVAL || error == ENOSYS)
+        mCanSplice[channel] = false;
+    errno = error;
+    return -1;
+}
+
+// The returned array references the internal buffer and is only valid until the next call.
+QByteArray OutputForwarder::read(Channel channel)
+{
+    if (mReadFd[channel] < 0)
+        return QByteArray();
+
+    const ssize_t size = ::read(mReadFd[channel], mBuffer.data(), mBuffer.size());
+    if (size > 0)
+        return QByteArray::fromRawData(mBuffer.constData(), size);
+
+    if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        closeChannel(channel);
+    return QByteArray();
+}
+
+void OutputForwarder::activated(int fd)
+{
+    if (fd == mReadFd[StandardOutput])
+        emit readyReadStandardOutput();
+    else if (fd == mReadFd[StandardError])
+        emit readyReadStandardError();
+}
+
+void OutputForwarder::closeChannel(Channel channel)
+{
+    if (mNotifier[channel]) {
+        mNotifier[channel]->setEnabled(false);
+        mNotifier[channel]->deleteLater();
+        mNotifier[channel] = 0;
+    }
+    if (mReadFd[channel] >= 0) {
+        ::close(mReadFd[channel]);
+        mReadFd[channel] = -1;
+    }
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef OUTPUTFORWARDER_H
+#define OUTPUTFORWARDER_H
+
+#include <QObject>
+#include <QByteArray>
+
+class QSocketNotifier;
+
+// Owns the pipes connected to stdout and stderr of the child process.
+// Output is moved to its destination with splice() where the kernel supports it
+// and read into a single reusable buffer otherwise.
+class OutputForwarder : public QObject
+{
+    Q_OBJECT
+public:
+    enum Channel {
+        StandardOutput,
+        StandardError,
+        ChannelCount
+    };
+
+    explicit OutputForwarder(QObject *parent = 0);
+    ~OutputForwarder();
+
+    bool open();
+    void setupChildProcess();
+    void childStarted();
+    void close();
+
+    bool isOpen(Channel channel) const;
+    bool canSplice(Channel channel) const;
+    int bytesAvailable(Channel channel) const;
+    qint64 splice(Channel channel, int fd);
+    QByteArray read(Channel channel);
+
+signals:
+    void readyReadStandardOutput();
+    void readyReadStandardError();
+
+private slots:
+    void activated(int fd);
+
+private:
+    void closeChannel(Channel channel);
+
+    int mReadFd[ChannelCount];
+    int mWriteFd[ChannelCount];
+    bool mCanSplice[ChannelCount];
+    QSocketNotifier *mNotifier[ChannelCount];
+    QByteArray mBuffer;
+};
+
+#endif // OUTPUTFORWARDER_H
@@ -0,0 +1,338 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "outputpipeline.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QString>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+struct RecordHeader {
+    int fd;
+    int size;
+};
+
+const int HeaderSize = sizeof(RecordHeader);
+const int MinimumCapacity = 16 * 1024;
+const int AbortInterval = 100; // ms between attempts to interrupt the writer
+const int InterruptCheckInterval = 100; // ms between checks for a signal while blocked
+
+// Installed without SA_RESTART, so that a blocked write() or poll() fails with EINTR
+void interruptWriter(int)
+{
+}
+
+bool isReadable(int fd)
+{
+    if (fd < 0)
+        return false;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+} // anonymous namespace
+
+OutputPipeline::OutputPipeline(int capacity, Policy policy, QObject *parent)
+    : QThread(parent)
+    , mCapacity(qMax(capacity, MinimumCapacity))
+    , mMaxChunk(mCapacity / 4 - HeaderSize)
+    , mPolicy(policy)
+    , mRing(mCapacity, Qt::Uninitialized)
+    , mRead(0)
+    , mWrite(0)
+    , mFinishing(false)
+    , mFailed(false)
+    , mAborted(false)
+    , mWriterThread(0)
+    , mInterruptFd(-1)
+    , mDroppedBytes(0)
+    , mDroppedChunks(0)
+    , mProducerStalls(0)
+    , mProducerStallTime(0)
+    , mWriterStalls(0)
+    , mWriterStallTime(0)
+    , mPeakFill(0)
+{
+}
+
+OutputPipeline::~OutputPipeline()
+{
+    finish();
+}
+
+bool OutputPipeline::parsePolicy(const QString &name, Policy *policy)
+{
+    if (name == QLatin1String("block"))
+        *policy = Block;
+    else if (name == QLatin1String("drop-oldest"))
+        *policy = DropOldest;
+    else if (name == QLatin1String("drop-newest"))
+        *policy = DropNewest;
+    else
+        return false;
+    return true;
+}
+
+void OutputPipeline::setInterruptFd(int fd)
+{
+    Q_ASSERT(!isRunning());
+    mInterruptFd = fd;
+}
+
+void OutputPipeline::write(int fd, const char *data, int size)
+{
+    if (!isRunning())
+        start();
+
+    while (size > 0) {
+        const int chunk = qMin(size, mMaxChunk);
+        append(fd, data, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+// Waits until everything queued has been written and stops the writer thread. A destination
+// that does not take the output within timeout ms must not keep the controller from exiting.
+void OutputPipeline::finish(int timeout)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mFinishing = true;
+        mNotEmpty.wakeAll();
+    }
+
+    if (!wait(timeout)) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = interruptWriter;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, 0);
+
+        pthread_t writer;
+        qint64 discarded;
+        {
+            QMutexLocker locker(&mMutex);
+            mAborted = true;
+            discarded = mWrite - mRead;
+            mRead = mWrite;
+            writer = mWriterThread;
+        }
+        do {
+            pthread_kill(writer, SIGUSR1);
+        } while (!wait(AbortInterval));
+        fprintf(stderr, "AppController: Output destination stalled for %d ms, discarded %lld queued bytes\n",
+                timeout, discarded);
+    }
+
+    QMutexLocker locker(&mMutex);
+    mFinishing = false;
+    mFailed = false;
+    mAborted = false;
+    mRead = mWrite = 0;
+}
+
+void OutputPipeline::printStatistics() const
+{
+    QMutexLocker locker(&mMutex);
+    printf("AppController: Output buffer peak %d of %d bytes, dropped %lld bytes in %d chunks, "
+           "application stalled %d times for %lld ms, writer stalled %d times for %lld ms\n",
+           mPeakFill, mCapacity, mDroppedBytes, mDroppedChunks,
+           mProducerStalls, mProducerStallTime / 1000000, mWriterStalls, mWriterStallTime / 1000000);
+}
+
+void OutputPipeline::append(int fd, const char *data, int size)
+{
+    QMutexLocker locker(&mMutex);
+    if (mFailed)
+        return;
+
+    const int needed = HeaderSize + size;
+    if (mCapacity - (mWrite - mRead) < needed) {
+        switch (mPolicy) {
+        case DropNewest:
+            mDroppedBytes += size;
+            ++mDroppedChunks;
+            return;
+        case DropOldest:
+            while (mCapacity - (mWrite - mRead) < needed)
+                dropOldest();
+            break;
+        case Block: {
+            QElapsedTimer timer;
+            timer.start();
+            ++mProducerStalls;
+            // This is the event loop's thread, it must not miss SIGTERM or --stop
+            while (mCapacity - (mWrite - mRead) < needed && !mFailed) {
+                if (!mNotFull.wait(&mMutex, InterruptCheckInterval) && isReadable(mInterruptFd))
+                    interrupted();
+            }
+            mProducerStallTime += timer.nsecsElapsed();
+            if (mFailed)
+                return;
+            break;
+        }
+        }
+    }
+
+    RecordHeader header;
+    header.fd = fd;
+    header.size = size;
+    copyIn(mWrite, reinterpret_cast<const char *>(&header), HeaderSize);
+    copyIn(mWrite + HeaderSize, data, size);
+    mWrite += needed;
+    mPeakFill = qMax(mPeakFill, int(mWrite - mRead));
+    mNotEmpty.wakeOne();
+}
+
+void OutputPipeline::copyIn(qint64 pos, const char *data, int size)
+{
+    const int offset = pos % mCapacity;
+    const int first = qMin(size, mCapacity - offset);
+    memcpy(mRing.data() + offset, data, first);
+    memcpy(mRing.data(), data + first, size - first);
+}
+
+void OutputPipeline::copyOut(qint64 pos, char *data, int size) const
+{
+    const int offset = pos % mCapacity;
+    const int first = qMin(size, mCapacity - offset);
+    memcpy(data, mRing.constData() + offset, first);
+    memcpy(data + first, mRing.constData(), size - first);
+}
+
+void OutputPipeline::dropOldest()
+{
+    RecordHeader header;
+    copyOut(mRead, reinterpret_cast<char *>(&header), HeaderSize);
+    mRead += HeaderSize + header.size;
+    mDroppedBytes += header.size;
+    ++mDroppedChunks;
+}
+
+void OutputPipeline::run()
+{
+    QByteArray chunk(mMaxChunk, Qt::Uninitialized);
+    {
+        QMutexLocker locker(&mMutex);
+        mWriterThread = pthread_self();
+    }
+
+    forever {
+        RecordHeader header;
+        {
+            QMutexLocker locker(&mMutex);
+            while (mRead == mWrite && !mFinishing)
+                mNotEmpty.wait(&mMutex);
+            if (mRead == mWrite)
+                break;
+            copyOut(mRead, reinterpret_cast<char *>(&header), HeaderSize);
+            copyOut(mRead + HeaderSize, chunk.data(), header.size);
+            mRead += HeaderSize + header.size;
+            mNotFull.wakeAll();
+        }
+
+        if (!writeAll(header.fd, chunk.constData(), header.size)) {
+            const int error = errno;
+            if (isAborted())
+                break;
+            QMutexLocker locker(&mMutex);
+            if (mFailed)
+                break; // interrupted
+            fprintf(stderr, "Cannot forward application output: %d - %s\n", error, strerror(error));
+            mFailed = true;
+            mRead = mWrite;
+            mNotFull.wakeAll();
+            emit writeFailed();
+            break;
+        }
+    }
+}
+
+bool OutputPipeline::writeAll(int fd, const char *data, int size)
+{
+    while (size > 0) {
+        const ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                if (isAborted())
+                    return false;
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return false;
+
+            QElapsedTimer timer;
+            timer.start();
+            struct pollfd pfds[2];
+            pfds[0].fd = fd;
+            pfds[0].events = POLLOUT;
+            pfds[0].revents = 0;
+            pfds[1].fd = mInterruptFd; // ignored by poll() when negative
+            pfds[1].events = POLLIN;
+            pfds[1].revents = 0;
+            const int ready = poll(pfds, 2, -1);
+            const int error = errno;
+            {
+                QMutexLocker locker(&mMutex);
+                ++mWriterStalls;
+                mWriterStallTime += timer.nsecsElapsed();
+                if (ready > 0 && (pfds[1].revents & POLLIN) && !(pfds[0].revents & POLLOUT)) {
+                    interrupted();
+                    return false;
+                }
+            }
+            if ((ready < 0 && error != EINTR) || isAborted()) {
+                errno = error;
+                return false;
+            }
+            continue;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool OutputPipeline::isAborted() const
+{
+    QMutexLocker locker(&mMutex);
+    return mAborted;
+}
+
+// Called with mMutex locked when a signal arrived while one side waited for the destination.
+// Like the select() of the unbuffered path, the output is given up and the controller stops.
+void OutputPipeline::interrupted()
+{
+    if (mFailed)
+        return;
+    fprintf(stderr, "AppController: Signal received while the output destination stalled, "
+            "discarded %lld queued bytes\n", mWrite - mRead);
+    mFailed = true;
+    mRead = mWrite;
+    mNotFull.wakeAll();
+}
@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef OUTPUTPIPELINE_H
+#define OUTPUTPIPELINE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+#include <pthread.h>
+
+// Decouples reading the application output from writing it to a slow destination.
+// Chunks are queued in a bounded ring buffer and written by a dedicated thread, so the
+// event loop never waits in select() for the destination to become writable.
+class OutputPipeline : public QThread
+{
+    Q_OBJECT
+public:
+    enum Policy {
+        Block,      // wait for the writer, the application blocks on its full pipe
+        DropOldest, // discard the oldest queued chunks to make room
+        DropNewest  // discard the incoming chunk
+    };
+
+    OutputPipeline(int capacity, Policy policy, QObject *parent = 0);
+    ~OutputPipeline();
+
+    // Once fd is readable, e.g. SignalNotifier::fd(), neither side waits for the destination
+    // any longer and the queued output is discarded, so that the event loop can handle the signal
+    void setInterruptFd(int fd);
+
+    void write(int fd, const char *data, int size);
+    // Waits up to timeout ms for the queued output to be written, then discards the rest
+    void finish(int timeout = DefaultDrainTimeout);
+    void printStatistics() const;
+
+    static bool parsePolicy(const QString &name, Policy *policy);
+
+    static const int DefaultDrainTimeout = 5000; // ms
+
+signals:
+    void writeFailed();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    void append(int fd, const char *data, int size);
+    void copyIn(qint64 pos, const char *data, int size);
+    void copyOut(qint64 pos, char *data, int size) const;
+    void dropOldest();
+    bool writeAll(int fd, const char *data, int size);
+    bool isAborted() const;
+    void interrupted();
+
+    const int mCapacity;
+    const int mMaxChunk;
+    const Policy mPolicy;
+    QByteArray mRing;
+    qint64 mRead;
+    qint64 mWrite;
+    bool mFinishing;
+    bool mFailed;
+    bool mAborted;
+    pthread_t mWriterThread;
+    int mInterruptFd;
+
+    mutable QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    QWaitCondition mNotFull;
+
+    // Statistics, protected by mMutex
+    qint64 mDroppedBytes;
+    int mDroppedChunks;
+    int mProducerStalls;
+    qint64 mProducerStallTime; // ns
+    int mWriterStalls;
+    qint64 mWriterStallTime;   // ns
+    int mPeakFill;
+};
+
+#endif // OUTPUTPIPELINE_H
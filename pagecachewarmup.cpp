@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "pagecachewarmup.h"
+#include <QFile>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QElapsedTimer>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+static const int MaxThreads = 8;
+
+class WarmupTask : public QRunnable
+{
+public:
+    WarmupTask(PageCacheWarmup *warmup, const QString &fileName, bool lock)
+        : mWarmup(warmup), mFileName(fileName), mLock(lock)
+    {
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        const int fd = open(QFile::encodeName(mFileName).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        void *address = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            address = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+
+        // Count what is not cached yet, that is what the application would have faulted in
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        const size_t pages = (st.st_size + pageSize - 1) / pageSize;
+        QVector<unsigned char> residency(int(pages));
+        qint64 missing = 0;
+        if (mincore(address, st.st_size, residency.data()) == 0) {
+            for (size_t i = 0; i < pages; ++i) {
+                if (!(residency.at(int(i)) & 1))
+                    ++missing;
+            }
+            missing *= pageSize;
+        }
+
+        if (readahead(fd, 0, st.st_size) != 0)
+            posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+        close(fd);
+
+        const bool locked = mLock && mlock(address, st.st_size) == 0;
+        if (!locked)
+            munmap(address, st.st_size);
+
+        QMutexLocker locker(&mWarmup->mMutex);
+        mWarmup->mTotalBytes += st.st_size;
+        mWarmup->mMissingBytes += qMin(missing, qint64(st.st_size));
+        if (locked) {
+            PageCacheWarmup::Mapping mapping = { address, size_t(st.st_size) };
+            mWarmup->mLocked.append(mapping);
+        } else if (mLock) {
+            ++mWarmup->mLockFailures;
+        }
+    }
+
+private:
+    PageCacheWarmup *mWarmup;
+    QString mFileName;
+    bool mLock;
+};
+
+PageCacheWarmup::PageCacheWarmup()
+    : mTotalBytes(0)
+    , mMissingBytes(0)
+    , mLockFailures(0)
+{
+}
+
+PageCacheWarmup::~PageCacheWarmup()
+{
+    release();
+}
+
+bool PageCacheWarmup::parseMode(const QString &name, Mode *mode)
+{
+    if (name == QLatin1String("none"))
+        *mode = None;
+    else if (name == QLatin1String("readahead"))
+        *mode = Readahead;
+    else if (name == QLatin1String("lock"))
+        *mode = Lock;
+    else
+        return false;
+    return true;
+}
+
+void PageCacheWarmup::run(Mode mode, const QStringList &files)
+{
+    release();
+    if (mode == None || files.isEmpty())
+        return;
+
+    mTotalBytes = 0;
+    mMissingBytes = 0;
+    mLockFailures = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMin(files.size(), MaxThreads));
+    foreach (const QString &file, files)
+        pool.start(new WarmupTask(this, file, mode == Lock));
+    pool.waitForDone();
+
+    printf("AppController: Warmed up %d files in %lld ms, %lld of %lld KiB were not cached\n",
+           files.size(), timer.elapsed(), mMissingBytes / 1024, mTotalBytes / 1024);
+    if (mLockFailures)
+        printf("AppController: Could not lock %d files in memory, check RLIMIT_MEMLOCK\n",
+               mLockFailures);
+}
+
+void PageCacheWarmup::release()
+{
+    foreach (const Mapping &mapping, mLocked) {
+        munlock(mapping.address, mapping.size);
+        munmap(mapping.address, mapping.size);
+    }
+    mLocked.clear();
+}
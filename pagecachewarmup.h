@@ -0,0 +1,62 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PAGECACHEWARMUP_H
+#define PAGECACHEWARMUP_H
+
+#include <QStringList>
+#include <QVector>
+#include <QMutex>
+
+// Reads the binary and its libraries into the page cache before exec, in parallel, so
+// that the application does not stall on one page fault after the other. In Lock mode
+// the files also stay locked in memory until release().
+class PageCacheWarmup
+{
+public:
+    enum Mode {
+        None,
+        Readahead,
+        Lock
+    };
+
+    PageCacheWarmup();
+    ~PageCacheWarmup();
+
+    static bool parseMode(const QString &name, Mode *mode);
+
+    // Blocks until all files are cached and prints what was read
+    void run(Mode mode, const QStringList &files);
+    void release();
+
+private:
+    friend class WarmupTask;
+
+    struct Mapping {
+        void *address;
+        size_t size;
+    };
+
+    QMutex mMutex;
+    QVector<Mapping> mLocked;
+    qint64 mTotalBytes;
+    qint64 mMissingBytes;
+    int mLockFailures;
+};
+
+#endif // PAGECACHEWARMUP_H
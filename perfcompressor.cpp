@@ -0,0 +1,173 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "perfcompressor.h"
+#include <QByteArray>
+#include <QtEndian>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int BlockSize = 256 * 1024;
+static const int FlushInterval = 100; // ms
+static const int CompressionLevel = 1;
+
+PerfCompressor::PerfCompressor(qintptr socketDescriptor, QObject *parent)
+    : QThread(parent)
+    , mSocketDescriptor(socketDescriptor)
+    , mSocketFd(-1)
+    , mReadFd(-1)
+    , mWriteFd(-1)
+    , mRawBytes(0)
+    , mCompressedBytes(0)
+{
+}
+
+PerfCompressor::~PerfCompressor()
+{
+    // Closing the write end lets run() see EOF, flush the last block and finish the stream
+    if (mWriteFd >= 0)
+        close(mWriteFd);
+    wait();
+    if (mReadFd >= 0)
+        close(mReadFd);
+    if (mSocketFd >= 0)
+        close(mSocketFd);
+}
+
+bool PerfCompressor::open()
+{
+    // Keep our own descriptor, the QTcpSocket may be destroyed before the stream is finished
+    mSocketFd = fcntl(mSocketDescriptor, F_DUPFD_CLOEXEC, 0);
+    if (mSocketFd < 0) {
+        perror("Could not duplicate perf socket");
+        return false;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        perror("Could not create compression pipe");
+        return false;
+    }
+    mReadFd = fds[0];
+    mWriteFd = fds[1];
+
+    start();
+    return true;
+}
+
+int PerfCompressor::inputFd() const
+{
+    return mWriteFd;
+}
+
+void PerfCompressor::run()
+{
+    QByteArray block(BlockSize, Qt::Uninitialized);
+    int fill = 0;
+
+    forever {
+        struct pollfd pfd;
+        pfd.fd = mReadFd;
+        pfd.events = POLLIN;
+        const int ready = poll(&pfd, 1, fill > 0 ? FlushInterval : -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (ready == 0) {
+            // perf is idle, don't hold back what we have
+            if (!flush(block.constData(), fill))
+                break;
+            fill = 0;
+            continue;
+        }
+
+        const ssize_t size = read(mReadFd, block.data() + fill, BlockSize - fill);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            break;
+
+        fill += size;
+        if (fill == BlockSize) {
+            if (!flush(block.constData(), fill))
+                break;
+            fill = 0;
+        }
+    }
+
+    if (flush(block.constData(), fill)) {
+        const quint32 endOfStream = 0;
+        writeAll(reinterpret_cast<const char *>(&endOfStream), sizeof(endOfStream));
+    }
+
+    if (mRawBytes > 0) {
+        fprintf(stderr, "AppController: Compressed perf stream from %lld to %lld bytes\n",
+                mRawBytes, mCompressedBytes);
+    }
+
+    // Make further writes into the pipe fail, so that the application output is not lost silently
+    close(mReadFd);
+    mReadFd = -1;
+}
+
+bool PerfCompressor::flush(const char *data, int size)
+{
+    if (size == 0)
+        return true;
+
+    const QByteArray compressed = qCompress(reinterpret_cast<const uchar *>(data), size,
+                                            CompressionLevel);
+    const quint32 header = qToBigEndian<quint32>(compressed.size());
+    if (!writeAll(reinterpret_cast<const char *>(&header), sizeof(header))
+            || !writeAll(compressed.constData(), compressed.size())) {
+        fprintf(stderr, "Cannot forward compressed perf output: %d - %s\n", errno, strerror(errno));
+        return false;
+    }
+
+    mRawBytes += size;
+    mCompressedBytes += sizeof(header) + compressed.size();
+    return true;
+}
+
+bool PerfCompressor::writeAll(const char *data, int size)
+{
+    while (size > 0) {
+        const ssize_t written = write(mSocketFd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+                pfd.fd = mSocketFd;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                    continue;
+            }
+            return false;
+        }
+        size -= written;
+        data += written;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PERFCOMPRESSOR_H
+#define PERFCOMPRESSOR_H
+
+#include <QThread>
+
+// A client that wants a compressed perf stream sends PerfCompressionMagic right after
+// connecting. If the controller supports compression, it answers with the same magic and
+// then sends frames consisting of a big endian quint32 length followed by that many bytes of
+// qCompress() output. A frame of length 0 marks the end of the stream.
+static const char PerfCompressionMagic[] = "QPERFZ1\n";
+static const int PerfCompressionMagicSize = sizeof(PerfCompressionMagic) - 1;
+
+// Reads the perf output from a pipe, compresses it in blocks and writes the frames to the
+// socket on its own thread, so that the event loop never waits for the network.
+class PerfCompressor : public QThread
+{
+public:
+    PerfCompressor(qintptr socketDescriptor, QObject *parent = 0);
+    ~PerfCompressor();
+
+    bool open();
+    int inputFd() const;
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    bool flush(const char *data, int size);
+    bool writeAll(const char *data, int size);
+
+    qintptr mSocketDescriptor;
+    int mSocketFd;
+    int mReadFd;
+    int mWriteFd;
+    qint64 mRawBytes;
+    qint64 mCompressedBytes;
+};
+
+#endif // PERFCOMPRESSOR_H
@@ -0,0 +1,232 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+// Host side counterpart of the compressed perf transport. Connects to the perf port opened by
+// "appcontroller --profile-perf", requests compression and writes the plain "perf record -o -"
+// stream to a file or stdout, e.g. for "perf report -i -". With --resume it reconnects after
+// a dropped connection and resumes the stream of "appcontroller --perf-buffer", see perfspool.h.
+
+#include "perfcompressor.h"
+#include "perfspool.h"
+#include <QCoreApplication>
+#include <QTcpSocket>
+#include <QFile>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtEndian>
+#include <stdio.h>
+
+static const int ConnectTimeout = 10000;   // ms
+static const int ReconnectInterval = 1000; // ms
+static const int ReconnectTimeout = 60000; // ms until giving up on a dropped connection
+
+static void usage()
+{
+    printf("appcontroller-perfdecompressor [--resume] <host> <port> [output file]\n"
+           "\n"
+           "Receives the perf stream of appcontroller --profile-perf in compressed form and\n"
+           "writes it uncompressed to the given file or to stdout.\n"
+           "\n"
+           "--resume  Reconnect when the connection drops and resume where the stream left off.\n"
+           "          Needs appcontroller --perf-buffer, which sends the stream uncompressed.\n");
+}
+
+static bool readFully(QTcpSocket *socket, char *data, qint64 size)
+{
+    while (size > 0) {
+        if (socket->bytesAvailable() == 0 && !socket->waitForReadyRead(-1))
+            return false;
+        const qint64 read = socket->read(data, size);
+        if (read < 0)
+            return false;
+        data += read;
+        size -= read;
+    }
+    return true;
+}
+
+// Copies the plain stream until the connection ends
+static bool receivePlain(QTcpSocket *socket, QFile *output, qint64 *received)
+{
+    while (socket->state() == QAbstractSocket::ConnectedState || socket->bytesAvailable() > 0) {
+        if (socket->bytesAvailable() == 0 && !socket->waitForReadyRead(-1))
+            break;
+        const QByteArray data = socket->readAll();
+        if (output->write(data) != data.size()) {
+            fprintf(stderr, "Could not write output: %s\n", qPrintable(output->errorString()));
+            return false;
+        }
+        *received += data.size();
+    }
+    return true;
+}
+
+enum ResumeResult {
+    Resumed,
+    Finished,
+    Failed
+};
+
+// A refused connection means that appcontroller has exited after sending everything
+static ResumeResult resume(QTcpSocket *socket, const QString &host, quint16 port, qint64 received)
+{
+    QElapsedTimer timer;
+    timer.start();
+    forever {
+        socket->abort();
+        socket->connectToHost(host, port);
+        if (socket->waitForConnected(ConnectTimeout)) {
+            const quint64 offset = qToBigEndian<quint64>(received);
+            socket->write(PerfResumeMagic, PerfResumeMagicSize);
+            socket->write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+            QByteArray reply(PerfResumeMagicSize + sizeof(quint64), Qt::Uninitialized);
+            if (readFully(socket, reply.data(), reply.size())) {
+                if (!reply.startsWith(QByteArray(PerfResumeMagic, PerfResumeMagicSize))) {
+                    fprintf(stderr, "The device does not support resuming, run appcontroller with --perf-buffer\n");
+                    return Failed;
+                }
+                const quint64 position = qFromBigEndian<quint64>(
+                            reinterpret_cast<const uchar *>(reply.constData() + PerfResumeMagicSize));
+                if (position != quint64(received)) {
+                    fprintf(stderr, "The device no longer holds the stream after byte %lld\n", received);
+                    return Failed;
+                }
+                fprintf(stderr, "Resumed the perf stream after %lld bytes\n", received);
+                return Resumed;
+            }
+        } else if (socket->error() == QAbstractSocket::ConnectionRefusedError) {
+            return Finished;
+        }
+        if (timer.elapsed() > ReconnectTimeout) {
+            fprintf(stderr, "Could not reconnect: %s\n", qPrintable(socket->errorString()));
+            return Failed;
+        }
+        QThread::msleep(ReconnectInterval);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    args.removeFirst();
+
+    const bool resumable = !args.isEmpty() && args.first() == QLatin1String("--resume");
+    if (resumable)
+        args.removeFirst();
+
+    if (args.size() < 2 || args.size() > 3) {
+        usage();
+        return 1;
+    }
+
+    bool ok = false;
+    const quint16 port = args.at(1).toUShort(&ok);
+    if (!ok) {
+        fprintf(stderr, "Invalid port %s\n", qPrintable(args.at(1)));
+        return 1;
+    }
+
+    QFile output;
+    if (args.size() == 3) {
+        output.setFileName(args.at(2));
+        ok = output.open(QFile::WriteOnly | QFile::Truncate);
+    } else {
+        ok = output.open(stdout, QFile::WriteOnly);
+    }
+    if (!ok) {
+        fprintf(stderr, "Could not open output: %s\n", qPrintable(output.errorString()));
+        return 1;
+    }
+
+    QTcpSocket socket;
+    socket.connectToHost(args.at(0), port);
+    if (!socket.waitForConnected(ConnectTimeout)) {
+        fprintf(stderr, "Could not connect: %s\n", qPrintable(socket.errorString()));
+        return 1;
+    }
+    socket.write(PerfCompressionMagic, PerfCompressionMagicSize);
+    socket.waitForBytesWritten(ConnectTimeout);
+
+    QByteArray reply(PerfCompressionMagicSize, Qt::Uninitialized);
+    if (!readFully(&socket, reply.data(), reply.size())) {
+        fprintf(stderr, "Connection closed before any data was received\n");
+        return 1;
+    }
+
+    if (reply != QByteArray(PerfCompressionMagic, PerfCompressionMagicSize)) {
+        // The controller does not support compression and sends the plain stream
+        fprintf(stderr, "Compression not supported by the device, receiving uncompressed data\n");
+        output.write(reply);
+        qint64 received = reply.size();
+        forever {
+            if (!receivePlain(&socket, &output, &received))
+                return 1;
+            if (!resumable)
+                return 0;
+            output.flush();
+            switch (resume(&socket, args.at(0), port, received)) {
+            case Resumed:
+                break;
+            case Finished:
+                fprintf(stderr, "Received %lld bytes\n", received);
+                return 0;
+            case Failed:
+                return 1;
+            }
+        }
+    }
+
+    if (resumable)
+        fprintf(stderr, "The device sends a compressed stream, which cannot be resumed\n");
+
+    qint64 compressedBytes = 0;
+    qint64 rawBytes = 0;
+    forever {
+        quint32 header;
+        if (!readFully(&socket, reinterpret_cast<char *>(&header), sizeof(header))) {
+            fprintf(stderr, "Stream ended unexpectedly\n");
+            return 1;
+        }
+        const quint32 size = qFromBigEndian(header);
+        if (size == 0)
+            break;
+
+        QByteArray frame(size, Qt::Uninitialized);
+        if (!readFully(&socket, frame.data(), size)) {
+            fprintf(stderr, "Stream ended unexpectedly\n");
+            return 1;
+        }
+        const QByteArray data = qUncompress(frame);
+        if (data.isEmpty()) {
+            fprintf(stderr, "Corrupt frame in compressed stream\n");
+            return 1;
+        }
+        if (output.write(data) != data.size()) {
+            fprintf(stderr, "Could not write output: %s\n", qPrintable(output.errorString()));
+            return 1;
+        }
+        compressedBytes += sizeof(header) + size;
+        rawBytes += data.size();
+    }
+
+    output.close();
+    fprintf(stderr, "Received %lld bytes, %lld bytes uncompressed\n", compressedBytes, rawBytes);
+    return 0;
+}
@@ -0,0 +1,13 @@
+QT-=gui
+QT+=network
+CONFIG+=console
+CONFIG-=app_bundle
+
+TARGET=appcontroller-perfdecompressor
+INCLUDEPATH+=..
+
+SOURCES=\
+        main.cpp
+
+target.path = $$[QT_INSTALL_BINS]
+INSTALLS+=target
@@ -0,0 +1,379 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "perfeventsampler.h"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int DrainInterval = 100; // ms
+static const int DefaultFrequency = 1000; // Hz
+static const int DefaultMmapPages = 128;
+static const quint64 PerfMagic = 0x32454c4946524550ULL; // "PERFILE2"
+static const quint32 PerfRecordHeaderAttr = 64;
+static const quint32 PerfRecordFinishedRound = 68;
+
+struct PipeFileHeader {
+    quint64 magic;
+    quint64 size;
+};
+
+// Sent by the child together with the event
+struct ChildReply {
+    int error;
+    int excludeKernel;
+};
+
+PerfEventSampler::PerfEventSampler(const QStringList &params, QObject *parent)
+    : QObject(parent)
+    , mMmapPages(DefaultMmapPages)
+    , mOutputFd(-1)
+    , mParentSocket(-1)
+    , mChildSocket(-1)
+    , mEventFd(-1)
+    , mRing(MAP_FAILED)
+    , mRingSize(0)
+    , mBytes(0)
+    , mFailed(false)
+{
+    memset(&mAttr, 0, sizeof(mAttr));
+    mAttr.size = sizeof(mAttr);
+    mAttr.type = PERF_TYPE_SOFTWARE;
+    mAttr.config = PERF_COUNT_SW_CPU_CLOCK;
+    mAttr.freq = 1;
+    mAttr.sample_freq = DefaultFrequency;
+    mAttr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_PERIOD;
+    mAttr.disabled = 1;
+    mAttr.enable_on_exec = 1;
+    mAttr.inherit = 1;
+    mAttr.mmap = 1;
+    mAttr.comm = 1;
+    mAttr.task = 1;
+    mAttr.sample_id_all = 1;
+    mAttr.exclude_hv = 1;
+    parseParams(params);
+
+    mDrainTimer.setInterval(DrainInterval);
+    connect(&mDrainTimer, &QTimer::timeout, this, &PerfEventSampler::drain);
+}
+
+PerfEventSampler::~PerfEventSampler()
+{
+    close();
+}
+
+void PerfEventSampler::parseParams(const QStringList &params)
+{
+    for (int i = 0; i < params.size(); ++i) {
+        QString option = params.at(i);
+        QString value;
+        const int equals = option.indexOf(QLatin1Char('='));
+        if (option.startsWith(QLatin1String("--")) && equals > 0) {
+            value = option.mid(equals + 1);
+            option.truncate(equals);
+        }
+        const bool takesValue = option == QLatin1String("-F") || option == QLatin1String("--freq")
+                || option == QLatin1String("-c") || option == QLatin1String("--count")
+                || option == QLatin1String("-e") || option == QLatin1String("--event")
+                || option == QLatin1String("-m") || option == QLatin1String("--mmap-pages")
+                || option == QLatin1String("--call-graph");
+        if (takesValue && equals < 0 && i + 1 < params.size())
+            value = params.at(++i);
+
+        bool ok = true;
+        if (option == QLatin1String("-F") || option == QLatin1String("--freq")) {
+            const int frequency = value.toInt(&ok);
+            if (ok && frequency > 0) {
+                mAttr.freq = 1;
+                mAttr.sample_freq = frequency;
+            }
+        } else if (option == QLatin1String("-c") || option == QLatin1String("--count")) {
+            const quint64 period = value.toULongLong(&ok);
+            if (ok && period > 0) {
+                mAttr.freq = 0;
+                mAttr.sample_period = period;
+            }
+        } else if (option == QLatin1String("-e") || option == QLatin1String("--event")) {
+            QString event = value;
+            if (event.endsWith(QLatin1String(":u"))) {
+                mAttr.exclude_kernel = 1;
+                event.chop(2);
+            }
+            if (event == QLatin1String("cpu-clock")) {
+                mAttr.type = PERF_TYPE_SOFTWARE;
+                mAttr.config = PERF_COUNT_SW_CPU_CLOCK;
+            } else if (event == QLatin1String("task-clock")) {
+                mAttr.type = PERF_TYPE_SOFTWARE;
+                mAttr.config = PERF_COUNT_SW_TASK_CLOCK;
+            } else if (event == QLatin1String("cycles") || event == QLatin1String("cpu-cycles")) {
+                mAttr.type = PERF_TYPE_HARDWARE;
+                mAttr.config = PERF_COUNT_HW_CPU_CYCLES;
+            } else if (event == QLatin1String("instructions")) {
+                mAttr.type = PERF_TYPE_HARDWARE;
+                mAttr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            } else {
+                ok = false;
+            }
+        } else if (option == QLatin1String("-m") || option == QLatin1String("--mmap-pages")) {
+            const int pages = value.toInt(&ok);
+            ok = ok && pages > 0 && (pages & (pages - 1)) == 0;
+            if (ok)
+                mMmapPages = pages;
+        } else if (option == QLatin1String("-g") || option == QLatin1String("--call-graph")) {
+            mAttr.sample_type |= PERF_SAMPLE_CALLCHAIN;
+            if (!value.isEmpty() && !value.startsWith(QLatin1String("fp"))) {
+                fprintf(stderr, "AppController: The built-in sampler records frame pointer call graphs "
+                                "instead of %s\n", qPrintable(value));
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "AppController: The built-in sampler ignores %s %s\n",
+                    qPrintable(option), qPrintable(value));
+        }
+    }
+}
+
+void PerfEventSampler::setOutputFd(int fd)
+{
+    mOutputFd = fd;
+}
+
+bool PerfEventSampler::prepare()
+{
+    close();
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+        perror("Could not create socket pair for the built-in sampler");
+        return false;
+    }
+    mParentSocket = fds[0];
+    mChildSocket = fds[1];
+    return true;
+}
+
+void PerfEventSampler::setupChild()
+{
+    if (mChildSocket < 0)
+        return;
+
+    int fd = syscall(__NR_perf_event_open, &mAttr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0 && (errno == EACCES || errno == EPERM) && !mAttr.exclude_kernel) {
+        // perf_event_paranoid may only allow user space samples
+        mAttr.exclude_kernel = 1;
+        fd = syscall(__NR_perf_event_open, &mAttr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+    ChildReply reply;
+    reply.error = fd < 0 ? errno : 0;
+    reply.excludeKernel = mAttr.exclude_kernel;
+
+    struct iovec iov;
+    iov.iov_base = &reply;
+    iov.iov_len = sizeof(reply);
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (fd >= 0) {
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    if (sendmsg(mChildSocket, &message, MSG_NOSIGNAL) > 0 && fd >= 0) {
+        // Wait until the ring buffer is mapped, EOF if the controller gave up
+        char ack;
+        while (read(mChildSocket, &ack, 1) < 0 && errno == EINTR) { }
+    }
+    if (fd >= 0)
+        ::close(fd);
+}
+
+void PerfEventSampler::childForked()
+{
+    if (mParentSocket < 0)
+        return;
+    // Only the child's copy is left, recvmsg() sees EOF if there is no child
+    ::close(mChildSocket);
+    mChildSocket = -1;
+
+    ChildReply reply;
+    memset(&reply, 0, sizeof(reply));
+    struct iovec iov;
+    iov.iov_base = &reply;
+    iov.iov_len = sizeof(reply);
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t size;
+    do {
+        size = recvmsg(mParentSocket, &message, MSG_CMSG_CLOEXEC);
+    } while (size < 0 && errno == EINTR);
+
+    struct cmsghdr *cmsg = size > 0 ? CMSG_FIRSTHDR(&message) : 0;
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        memcpy(&mEventFd, CMSG_DATA(cmsg), sizeof(int));
+    if (mEventFd < 0) {
+        fprintf(stderr, "AppController: Could not open perf event: %s\n",
+                size > 0 ? strerror(reply.error) : "no reply from the child");
+        close();
+        return;
+    }
+    mAttr.exclude_kernel = reply.excludeKernel;
+
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    mRingSize = (1 + mMmapPages) * pageSize;
+    mRing = mmap(NULL, mRingSize, PROT_READ | PROT_WRITE, MAP_SHARED, mEventFd, 0);
+    if (mRing == MAP_FAILED) {
+        perror("Could not map perf ring buffer");
+        close();
+        return;
+    }
+
+    // The attribute comes first, the id lets perf match samples with it
+    quint64 id = 0;
+    const bool hasId = ioctl(mEventFd, PERF_EVENT_IOC_ID, &id) == 0;
+    QByteArray attr(sizeof(struct perf_event_header), Qt::Uninitialized);
+    struct perf_event_header *header = reinterpret_cast<struct perf_event_header *>(attr.data());
+    header->type = PerfRecordHeaderAttr;
+    header->misc = 0;
+    header->size = sizeof(struct perf_event_header) + sizeof(mAttr) + (hasId ? sizeof(id) : 0);
+    attr.append(reinterpret_cast<const char *>(&mAttr), sizeof(mAttr));
+    if (hasId)
+        attr.append(reinterpret_cast<const char *>(&id), sizeof(id));
+
+    const PipeFileHeader fileHeader = { PerfMagic, sizeof(PipeFileHeader) };
+    if (!writeAll(&fileHeader, sizeof(fileHeader)) || !writeAll(attr.constData(), attr.size()))
+        mFailed = true;
+
+    const char ack = 0;
+    if (write(mParentSocket, &ack, 1) != 1)
+        perror("Could not start the built-in sampler");
+    ::close(mParentSocket);
+    mParentSocket = -1;
+    mDrainTimer.start();
+}
+
+void PerfEventSampler::drain()
+{
+    if (mRing == MAP_FAILED)
+        return;
+
+    struct perf_event_mmap_page *meta = static_cast<struct perf_event_mmap_page *>(mRing);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    const quint64 dataOffset = meta->data_offset ? meta->data_offset : quint64(pageSize);
+    const quint64 dataSize = meta->data_size ? meta->data_size : quint64(mMmapPages) * pageSize;
+    const char *data = static_cast<const char *>(mRing) + dataOffset;
+
+    const quint64 head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    const quint64 tail = meta->data_tail;
+    if (head == tail)
+        return;
+
+    // The records are written as they are, the ring may wrap once
+    if (!mFailed) {
+        const quint64 start = tail % dataSize;
+        const quint64 size = head - tail;
+        const quint64 first = qMin(size, dataSize - start);
+        const struct perf_event_header round = {
+            PerfRecordFinishedRound, 0, sizeof(struct perf_event_header)
+        };
+        if (!writeAll(data + start, first) || !writeAll(data, size - first)
+                || !writeAll(&round, sizeof(round))) {
+            fprintf(stderr, "AppController: Cannot forward perf samples: %s\n", strerror(errno));
+            mFailed = true;
+        }
+        mBytes += size;
+    }
+    __atomic_store_n(&meta->data_tail, head, __ATOMIC_RELEASE);
+}
+
+void PerfEventSampler::finish()
+{
+    drain();
+    if (mEventFd >= 0)
+        fprintf(stderr, "AppController: Built-in sampler recorded %lld bytes\n", mBytes);
+    close();
+}
+
+bool PerfEventSampler::writeAll(const void *data, qint64 size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        const ssize_t written = write(mOutputFd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd;
+                pfd.fd = mOutputFd;
+                pfd.events = POLLOUT;
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                    continue;
+            }
+            return false;
+        }
+        size -= written;
+        bytes += written;
+    }
+    return true;
+}
+
+void PerfEventSampler::close()
+{
+    mDrainTimer.stop();
+    if (mRing != MAP_FAILED) {
+        munmap(mRing, mRingSize);
+        mRing = MAP_FAILED;
+    }
+    if (mEventFd >= 0) {
+        ::close(mEventFd);
+        mEventFd = -1;
+    }
+    if (mParentSocket >= 0) {
+        ::close(mParentSocket);
+        mParentSocket = -1;
+    }
+    if (mChildSocket >= 0) {
+        ::close(mChildSocket);
+        mChildSocket = -1;
+    }
+}
@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PERFEVENTSAMPLER_H
+#define PERFEVENTSAMPLER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include <linux/perf_event.h>
+
+// Sampling profiler for images without the perf binary. The child opens a sampling event
+// on itself between fork and exec (enabled on exec, inherited by its threads and children)
+// and passes it to the controller. It only execs once the controller has mapped the ring
+// buffer, so that no mmap records of the loader are lost. The controller streams the
+// ring buffer in the pipe format of perf.data, as "perf record -o -" would.
+//
+// Understands the "perf record" options -F/--freq, -c/--count, -e/--event with cpu-clock,
+// task-clock, cycles or instructions, -g/--call-graph (frame pointers) and -m/--mmap-pages.
+class PerfEventSampler : public QObject
+{
+    Q_OBJECT
+public:
+    PerfEventSampler(const QStringList &params, QObject *parent = 0);
+    ~PerfEventSampler();
+
+    void setOutputFd(int fd);
+
+    bool prepare();      // before fork
+    void setupChild();   // between fork and exec, async-signal-safe
+    void childForked();  // right after fork, lets the child exec
+    void finish();       // after the child has exited
+
+private slots:
+    void drain();
+
+private:
+    void parseParams(const QStringList &params);
+    bool writeAll(const void *data, qint64 size);
+    void close();
+
+    struct perf_event_attr mAttr;
+    int mMmapPages;
+    int mOutputFd;
+    int mParentSocket;
+    int mChildSocket;
+    int mEventFd;
+    void *mRing;
+    size_t mRingSize;
+    QTimer mDrainTimer;
+    qint64 mBytes;
+    bool mFailed;
+};
+
+#endif // PERFEVENTSAMPLER_H
@@ -17,11 +17,43 @@
 ****************************************************************************/
 
 #include "perfprocesshandler.h"
+#include "perfcompressor.h"
+#include "perfsnapshotsender.h"
+#include "perfspool.h"
+#include "perfeventsampler.h"
 #include <QTcpSocket>
+#include <QDir>
+#include <QFile>
+#include <QtEndian>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
 
-PerfProcessHandler::PerfProcessHandler(Process *process, const QStringList &allArgs) : mProcess(process), mAllArgs(allArgs)
+// Clients that don't know about compression start reading right away and never send anything,
+// so only wait briefly for the request.
+static const int NegotiationTimeout = 100; // ms
+static const int SnapshotTimeout = 10000; // ms
+
+PerfProcessHandler::PerfProcessHandler(Process *process, const QStringList &allArgs)
+    : mSocket(0), mProcess(process), mAllArgs(allArgs), mSnapshotSender(0), mCompressed(false)
+    , mSpool(0), mStarted(false), mEventSampler(0)
 {
     QObject::connect(&mServer, &QTcpServer::newConnection, this, &PerfProcessHandler::acceptConnection);
+    mNegotiationTimer.setSingleShot(true);
+    mNegotiationTimer.setInterval(NegotiationTimeout);
+    QObject::connect(&mNegotiationTimer, &QTimer::timeout, this, &PerfProcessHandler::negotiationTimeout);
+    mSnapshotTimer.setSingleShot(true);
+    mSnapshotTimer.setInterval(SnapshotTimeout);
+    QObject::connect(&mSnapshotTimer, &QTimer::timeout, this, &PerfProcessHandler::snapshotTimeout);
+    QObject::connect(&mSnapshotWatcher, &QFileSystemWatcher::directoryChanged,
+                     this, &PerfProcessHandler::snapshotWritten);
+}
+
+PerfProcessHandler::~PerfProcessHandler()
+{
+    delete mSnapshotSender;
+    if (!mSnapshotDirectory.isEmpty())
+        QDir(mSnapshotDirectory).removeRecursively();
 }
 
 QTcpServer *PerfProcessHandler::server()
@@ -29,11 +61,180 @@ QTcpServer *PerfProcessHandler::server()
     return &mServer;
 }
 
+bool PerfProcessHandler::setSnapshotDirectory(const QString &directory)
+{
+    if (!QDir().mkpath(directory) || !mSnapshotWatcher.addPath(directory))
+        return false;
+    mSnapshotDirectory = directory;
+    // Serves snapshots for as long as the process exists
+    setParent(mProcess);
+    return true;
+}
+
+void PerfProcessHandler::setEventSampler(PerfEventSampler *sampler)
+{
+    mEventSampler = sampler;
+}
+
+void PerfProcessHandler::setSpool(PerfSpool *spool)
+{
+    mSpool = spool;
+    // Takes further connections for as long as the process exists
+    setParent(mProcess);
+}
+
 void PerfProcessHandler::acceptConnection()
 {
-    QTcpSocket *socket = mServer.nextPendingConnection();
-    socket->setParent(mProcess);
-    mProcess->setStdoutFd(socket->socketDescriptor());
+    if (mSocket) {
+        // Only one snapshot at a time
+        if (!mSnapshotDirectory.isEmpty()) {
+            QTcpSocket *busy = mServer.nextPendingConnection();
+            busy->close();
+            busy->deleteLater();
+        }
+        return;
+    }
+    mSocket = mServer.nextPendingConnection();
+    mSocket->setParent(mProcess);
+    QObject::connect(mSocket, &QTcpSocket::readyRead, this, &PerfProcessHandler::negotiate);
+    mNegotiationTimer.start();
+    negotiate();
+}
+
+void PerfProcessHandler::negotiate()
+{
+    if (mSocket->bytesAvailable() < PerfCompressionMagicSize)
+        return;
+    if (mSpool && mSocket->peek(PerfResumeMagicSize) == QByteArray(PerfResumeMagic, PerfResumeMagicSize)) {
+        if (mSocket->bytesAvailable() < PerfResumeMagicSize + qint64(sizeof(quint64)))
+            return;
+        mNegotiationTimer.stop();
+        QObject::disconnect(mSocket, &QTcpSocket::readyRead, this, &PerfProcessHandler::negotiate);
+        mSocket->read(PerfResumeMagicSize);
+        const QByteArray offset = mSocket->read(sizeof(quint64));
+        attachToSpool(qint64(qFromBigEndian<quint64>(reinterpret_cast<const uchar *>(offset.constData()))));
+        return;
+    }
+    const QByteArray request = mSocket->read(PerfCompressionMagicSize);
+    startProcess(request == QByteArray(PerfCompressionMagic, PerfCompressionMagicSize));
+}
+
+void PerfProcessHandler::negotiationTimeout()
+{
+    startProcess(false);
+}
+
+void PerfProcessHandler::startProcess(bool compressed)
+{
+    mNegotiationTimer.stop();
+    QObject::disconnect(mSocket, &QTcpSocket::readyRead, this, &PerfProcessHandler::negotiate);
+
+    if (!mSnapshotDirectory.isEmpty()) {
+        requestSnapshot(compressed);
+        return;
+    }
+
+    if (mSpool) {
+        // Compression is not offered, resume offsets count stream bytes
+        attachToSpool(-1);
+        return;
+    }
+
+    qintptr fd = mSocket->socketDescriptor();
+    if (compressed) {
+        PerfCompressor *compressor = new PerfCompressor(fd, mProcess);
+        // Written directly, all following data bypasses the QTcpSocket as well
+        if (write(fd, PerfCompressionMagic, PerfCompressionMagicSize) == PerfCompressionMagicSize
+                && compressor->open()) {
+            fd = compressor->inputFd();
+        } else {
+            fprintf(stderr, "Could not set up compressed perf stream\n");
+            delete compressor;
+        }
+    }
+
+    // The built-in sampler writes the stream itself, the application keeps its stdout
+    if (mEventSampler)
+        mEventSampler->setOutputFd(fd);
+    else
+        mProcess->setStdoutFd(fd);
     mProcess->start(mAllArgs);
     this->deleteLater();
 }
+
+void PerfProcessHandler::requestSnapshot(bool compressed)
+{
+    if (!mProcess->isRunning()) {
+        fprintf(stderr, "AppController: No perf snapshot, perf is not running\n");
+        finishSnapshot();
+        return;
+    }
+    if (compressed && write(mSocket->socketDescriptor(), PerfCompressionMagic, PerfCompressionMagicSize)
+            != PerfCompressionMagicSize) {
+        finishSnapshot();
+        return;
+    }
+    mCompressed = compressed;
+
+    // Any file perf renames into place from now on is the requested snapshot
+    removeSnapshots();
+    mSnapshotTimer.start();
+    kill(mProcess->processId(), SIGUSR2);
+}
+
+void PerfProcessHandler::snapshotWritten()
+{
+    if (!mSnapshotTimer.isActive())
+        return;
+    const QDir directory(mSnapshotDirectory);
+    const QStringList snapshots = directory.entryList(QStringList() << QLatin1String("perf.data.*"),
+                                                      QDir::Files, QDir::Name);
+    if (snapshots.isEmpty())
+        return;
+
+    mSnapshotTimer.stop();
+    mSnapshotSender = new PerfSnapshotSender(directory.filePath(snapshots.first()),
+                                             mSocket->socketDescriptor(), mCompressed);
+    QObject::connect(mSnapshotSender, &QThread::finished, this, &PerfProcessHandler::snapshotSent);
+    mSnapshotSender->start();
+}
+
+void PerfProcessHandler::snapshotTimeout()
+{
+    fprintf(stderr, "AppController: perf did not write a snapshot within %d ms\n", SnapshotTimeout);
+    finishSnapshot();
+}
+
+void PerfProcessHandler::snapshotSent()
+{
+    QFile::remove(mSnapshotSender->fileName());
+    delete mSnapshotSender;
+    mSnapshotSender = 0;
+    finishSnapshot();
+}
+
+void PerfProcessHandler::finishSnapshot()
+{
+    mSocket->close();
+    mSocket->deleteLater();
+    mSocket = 0;
+}
+
+void PerfProcessHandler::removeSnapshots()
+{
+    const QDir directory(mSnapshotDirectory);
+    foreach (const QString &snapshot, directory.entryList(QStringList() << QLatin1String("perf.data.*"),
+                                                          QDir::Files))
+        QFile::remove(directory.filePath(snapshot));
+}
+
+void PerfProcessHandler::attachToSpool(qint64 offset)
+{
+    mSpool->setClient(mSocket, offset);
+    mSocket = 0;
+    if (!mStarted) {
+        mStarted = true;
+        mProcess->setStdoutFd(mSpool->inputFd());
+        mProcess->start(mAllArgs);
+    }
+}
@@ -21,22 +21,65 @@
 
 #include "process.h"
 #include <QTcpServer>
+#include <QTimer>
+#include <QFileSystemWatcher>
+
+class QTcpSocket;
+class PerfSnapshotSender;
+class PerfSpool;
+class PerfEventSampler;
 
 // Starts the process once a connection to the TCP server is established and then deletes itself.
+// A client may request a compressed stream right after connecting, see perfcompressor.h.
+//
+// In snapshot mode perf records into an overwritten ring buffer and writes it to the snapshot
+// directory on SIGUSR2 (--overwrite --switch-output). The process is started right away and
+// every connection receives a dump of the ring buffer, the most recent samples.
+//
+// With a spool the stream survives lost connections: the process keeps running and a new
+// connection continues the stream, where the client left off if it asks to resume.
 class PerfProcessHandler : public QObject {
     Q_OBJECT
 
 private:
     QTcpServer mServer;
+    QTimer mNegotiationTimer;
+    QTcpSocket *mSocket;
     Process *mProcess;
     QStringList mAllArgs;
+    QString mSnapshotDirectory;
+    QFileSystemWatcher mSnapshotWatcher;
+    QTimer mSnapshotTimer;
+    PerfSnapshotSender *mSnapshotSender;
+    bool mCompressed;
+    PerfSpool *mSpool;
+    bool mStarted;
+    PerfEventSampler *mEventSampler;
+
+    void startProcess(bool compressed);
+    void requestSnapshot(bool compressed);
+    void finishSnapshot();
+    void removeSnapshots();
+    void attachToSpool(qint64 offset);
 
 public:
     PerfProcessHandler(Process *process, const QStringList &allArgs);
+    ~PerfProcessHandler();
     QTcpServer *server();
+    bool setSnapshotDirectory(const QString &directory);
+    void setSpool(PerfSpool *spool);
+    // Streams from the built-in sampler instead of the stdout of perf, see perfeventsampler.h
+    void setEventSampler(PerfEventSampler *sampler);
 
 public slots:
     void acceptConnection();
+
+private slots:
+    void negotiate();
+    void negotiationTimeout();
+    void snapshotWritten();
+    void snapshotTimeout();
+    void snapshotSent();
 };
 
 #endif // PERFPROCESSHANDLER_H
@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "perfsnapshotsender.h"
+#include "perfcompressor.h"
+#include <QFile>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int BlockSize = 256 * 1024;
+
+PerfSnapshotSender::PerfSnapshotSender(const QString &fileName, qintptr socketDescriptor,
+                                       bool compressed, QObject *parent)
+    : QThread(parent)
+    , mFileName(fileName)
+    , mSocketFd(fcntl(socketDescriptor, F_DUPFD_CLOEXEC, 0))
+    , mCompressed(compressed)
+{
+}
+
+PerfSnapshotSender::~PerfSnapshotSender()
+{
+    wait();
+    if (mSocketFd >= 0)
+        close(mSocketFd);
+}
+
+QString PerfSnapshotSender::fileName() const
+{
+    return mFileName;
+}
+
+void PerfSnapshotSender::run()
+{
+    if (mSocketFd < 0)
+        return;
+    const int fileFd = open(QFile::encodeName(mFileName).constData(), O_RDONLY | O_CLOEXEC);
+    if (fileFd < 0) {
+        perror("Could not open perf snapshot");
+        return;
+    }
+
+    // The compressor lives on this thread, deleting it finishes the compressed stream
+    PerfCompressor *compressor = 0;
+    int targetFd = mSocketFd;
+    if (mCompressed) {
+        compressor = new PerfCompressor(mSocketFd);
+        if (!compressor->open()) {
+            fprintf(stderr, "Could not set up compressed perf stream\n");
+            delete compressor;
+            close(fileFd);
+            return;
+        }
+        targetFd = compressor->inputFd();
+    }
+
+    if (!copy(fileFd, targetFd))
+        fprintf(stderr, "Could not send perf snapshot: %s\n", strerror(errno));
+    delete compressor;
+    close(fileFd);
+}
+
+bool PerfSnapshotSender::copy(int fileFd, int targetFd)
+{
+    QByteArray block(BlockSize, Qt::Uninitialized);
+    forever {
+        const ssize_t size = read(fileFd, block.data(), BlockSize);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size < 0)
+            return false;
+        if (size == 0)
+            return true;
+
+        const char *data = block.constData();
+        ssize_t remaining = size;
+        while (remaining > 0) {
+            const ssize_t written = write(targetFd, data, remaining);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // The socket belongs to a QTcpSocket and is non-blocking
+                    struct pollfd pfd;
+                    pfd.fd = targetFd;
+                    pfd.events = POLLOUT;
+                    if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                        continue;
+                }
+                return false;
+            }
+            remaining -= written;
+            data += written;
+        }
+    }
+}
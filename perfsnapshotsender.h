@@ -0,0 +1,47 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PERFSNAPSHOTSENDER_H
+#define PERFSNAPSHOTSENDER_H
+
+#include <QThread>
+#include <QString>
+
+// Sends a finished perf snapshot file to a client on its own thread, optionally in the
+// compressed format of perfcompressor.h, and closes the connection afterwards.
+class PerfSnapshotSender : public QThread
+{
+public:
+    PerfSnapshotSender(const QString &fileName, qintptr socketDescriptor, bool compressed,
+                       QObject *parent = 0);
+    ~PerfSnapshotSender();
+
+    QString fileName() const;
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    bool copy(int fileFd, int targetFd);
+
+    QString mFileName;
+    int mSocketFd;
+    bool mCompressed;
+};
+
+#endif // PERFSNAPSHOTSENDER_H
@@ -0,0 +1,389 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "perfspool.h"
+#include <QTcpSocket>
+#include <QSocketNotifier>
+#include <QEventLoop>
+#include <QTimer>
+#include <QFile>
+#include <QtEndian>
+#include <linux/perf_event.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static const int ChunkSize = 64 * 1024;
+static const qint64 MaxPendingBytes = 256 * 1024; // queued in the QTcpSocket
+static const qint64 BoundaryInterval = 4096;     // bytes between remembered record offsets
+
+// perf.data in pipe mode starts with "PERFILE2" and the size of this header, then come
+// records with a struct perf_event_header. Tracing data records are followed by the
+// data itself, padded to 8 bytes, which their size does not include.
+static const int PipeHeaderSize = 16;
+static const quint32 HeaderTracingData = 66; // PERF_RECORD_HEADER_TRACING_DATA
+
+PerfSpool::PerfSpool(qint64 capacity, const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , mCapacity(capacity)
+    , mFileName(fileName)
+    , mFileFd(-1)
+    , mReadFd(-1)
+    , mWriteFd(-1)
+    , mInputNotifier(0)
+    , mClient(0)
+    , mBegin(0)
+    , mEnd(0)
+    , mPosition(0)
+    , mGap(0)
+    , mInputClosed(false)
+    , mHeaderEnd(-1)
+    , mNextRecord(0)
+    , mParseFailed(false)
+{
+}
+PerfSpool::~PerfSpool()
+{
+    if (mWriteFd >= 0)
+        close(mWriteFd);
+    if (mReadFd >= 0)
+        close(mReadFd);
+    if (mFileFd >= 0) {
+        close(mFileFd);
+        QFile::remove(mFileName);
+    }
+}
+
+bool PerfSpool::open()
+{
+    if (!mFileName.isEmpty()) {
+        mFileFd = ::open(QFile::encodeName(mFileName).constData(),
+                         O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (mFileFd < 0) {
+            perror("Could not open perf spill file");
+            return false;
+        }
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        perror("Could not create perf spool pipe");
+        return false;
+    }
+    mReadFd = fds[0];
+    mWriteFd = fds[1];
+    fcntl(mReadFd, F_SETFL, fcntl(mReadFd, F_GETFL) | O_NONBLOCK);
+
+    mInputNotifier = new QSocketNotifier(mReadFd, QSocketNotifier::Read, this);
+    connect(mInputNotifier, &QSocketNotifier::activated, this, &PerfSpool::readInput);
+    return true;
+}
+
+int PerfSpool::inputFd() const
+{
+    return mWriteFd;
+}
+
+void PerfSpool::setClient(QTcpSocket *socket, qint64 offset)
+{
+    const qint64 header = mHeader.size();
+    if (offset >= 0) {
+        const qint64 next = qMax(offset, header) + mGap;
+        if (next < mBegin || (offset > header && next > mEnd)) {
+            // Continuing later would cut the stream, the client has to start over
+            fprintf(stderr, "AppController: perf client cannot resume at %lld, the spool only holds "
+                    "%lld to %lld\n", offset, qMax(mBegin - mGap, header), mEnd - mGap);
+            const quint64 rejected = qToBigEndian<quint64>(PerfResumeRejected);
+            socket->setParent(this);
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            socket->write(PerfResumeMagic, PerfResumeMagicSize);
+            socket->write(reinterpret_cast<const char *>(&rejected), sizeof(rejected));
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+
+    if (mClient) {
+        disconnect(mClient, 0, this, 0);
+        mClient->abort();
+        mClient->deleteLater();
+    }
+    mClient = socket;
+    mClient->setParent(this);
+    connect(mClient, &QTcpSocket::bytesWritten, this, &PerfSpool::writeToClient);
+    connect(mClient, &QTcpSocket::disconnected, this, &PerfSpool::clientDisconnected);
+
+    if (offset >= 0) {
+        mPosition = offset;
+        const quint64 position = qToBigEndian<quint64>(mPosition);
+        mClient->write(PerfResumeMagic, PerfResumeMagicSize);
+        mClient->write(reinterpret_cast<const char *>(&position), sizeof(position));
+    } else {
+        mPosition = 0;
+        mGap = 0;
+        if (mBegin > header) {
+            // The ring wrapped, the header is followed by the oldest complete record held
+            qint64 next = mBoundaries.isEmpty() ? mNextRecord : mBoundaries.first();
+            if (mParseFailed || next < mBegin) {
+                fprintf(stderr, "AppController: perf stream record boundaries unknown, the stream "
+                        "continues at %lld and may not be readable\n", mBegin);
+                next = mBegin;
+            } else {
+                fprintf(stderr, "AppController: perf stream continues at %lld after the header, "
+                        "%lld bytes were dropped\n", next, next - header);
+            }
+            mGap = next - header;
+        }
+    }
+    writeToClient();
+}
+
+void PerfSpool::finish(int timeout)
+{
+    if (mWriteFd >= 0) {
+        close(mWriteFd);
+        mWriteFd = -1;
+    }
+    readInput();
+    if (mEnd == 0 || isDrained())
+        return;
+
+    fprintf(stderr, "AppController: Waiting up to %d s for the perf client to receive the rest of the stream\n",
+            timeout / 1000);
+    QEventLoop loop;
+    connect(this, &PerfSpool::drained, &loop, &QEventLoop::quit);
+    QTimer::singleShot(timeout, &loop, SLOT(quit()));
+    loop.exec();
+    if (mClient)
+        mClient->flush();
+}
+
+void PerfSpool::readInput()
+{
+    char chunk[ChunkSize];
+    while (!mInputClosed) {
+        const qint64 length = qMin(qint64(sizeof(chunk)), room());
+        if (length <= 0) {
+            // Continued by writeToClient() once the client has received more
+            mInputNotifier->setEnabled(false);
+            break;
+        }
+        const ssize_t size = read(mReadFd, chunk, length);
+        if (size < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("Could not read perf stream");
+            break;
+        }
+        if (size == 0) {
+            mInputClosed = true;
+            mInputNotifier->setEnabled(false);
+            break;
+        }
+        parse(chunk, size);
+        store(chunk, size);
+    }
+    writeToClient();
+}
+
+void PerfSpool::writeToClient()
+{
+    if (!mClient || mClient->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    char chunk[ChunkSize];
+    const qint64 header = mHeader.size();
+    while (mClient->bytesToWrite() < MaxPendingBytes) {
+        qint64 size;
+        if (mPosition < header) {
+            size = qMin(qint64(sizeof(chunk)), header - mPosition);
+            mClient->write(mHeader.constData() + mPosition, size);
+        } else {
+            const qint64 offset = mPosition + mGap;
+            if (offset >= mEnd)
+                break;
+            size = load(offset, chunk, qMin(qint64(sizeof(chunk)), mEnd - offset));
+            if (size <= 0)
+                break;
+            mClient->write(chunk, size);
+        }
+        mPosition += size;
+    }
+
+    if (!mInputClosed && !mInputNotifier->isEnabled() && room() > 0)
+        mInputNotifier->setEnabled(true);
+
+    if (isDrained()) {
+        mClient->flush();
+        emit drained();
+    }
+}
+
+void PerfSpool::clientDisconnected()
+{
+    // Whatever was still queued is lost, the client tells where to resume
+    mClient->deleteLater();
+    mClient = 0;
+    if (!mInputClosed)
+        mInputNotifier->setEnabled(true);
+    fprintf(stderr, "AppController: perf client disconnected, recording continues\n");
+}
+
+// Stream offset the client continues from once it has the header
+qint64 PerfSpool::sendOffset() const
+{
+    return qMax(mPosition, qint64(mHeader.size())) + mGap;
+}
+
+// How much may be read from perf without overwriting what the client still needs
+qint64 PerfSpool::room() const
+{
+    if (!mClient)
+        return mCapacity;
+    return mCapacity - (mEnd - sendOffset());
+}
+
+bool PerfSpool::isDrained() const
+{
+    return mInputClosed && mClient && mPosition >= mHeader.size() && mPosition + mGap >= mEnd
+            && mClient->bytesToWrite() == 0;
+}
+
+// Called before store(), with the data following mEnd
+void PerfSpool::parse(const char *data, qint64 size)
+{
+    const qint64 begin = mEnd;
+    const qint64 end = mEnd + size;
+    qint64 offset = begin;
+    while (!mParseFailed) {
+        if (offset < mNextRecord) {
+            offset = qMin(mNextRecord, end);
+            if (offset == end)
+                break;
+            continue;
+        }
+
+        int needed = mNextRecord == 0 ? PipeHeaderSize : int(sizeof(struct perf_event_header));
+        if (mNextRecord > 0 && mRecord.size() >= needed) {
+            quint32 type;
+            memcpy(&type, mRecord.constData(), sizeof(type));
+            if (type == HeaderTracingData)
+                needed += sizeof(quint32);
+        }
+        if (mRecord.size() < needed) {
+            if (offset == end)
+                break;
+            const qint64 length = qMin(qint64(needed - mRecord.size()), end - offset);
+            mRecord.append(data + (offset - begin), length);
+            offset += length;
+            continue;
+        }
+
+        if (mNextRecord == 0) {
+            quint64 headerSize;
+            memcpy(&headerSize, mRecord.constData() + 8, sizeof(headerSize));
+            if (memcmp(mRecord.constData(), "PERFILE2", 8) != 0 || headerSize < quint64(PipeHeaderSize)
+                    || headerSize > quint64(mCapacity)) {
+                mParseFailed = true;
+                break;
+            }
+            mNextRecord = headerSize;
+        } else {
+            struct perf_event_header record;
+            memcpy(&record, mRecord.constData(), sizeof(record));
+            if (record.size < sizeof(record)) {
+                mParseFailed = true;
+                break;
+            }
+            qint64 recordSize = record.size;
+            if (record.type == HeaderTracingData) {
+                quint32 dataSize;
+                memcpy(&dataSize, mRecord.constData() + sizeof(record), sizeof(dataSize));
+                recordSize += (qint64(dataSize) + 7) & ~qint64(7);
+            }
+            recordBoundary(mNextRecord, record.type);
+            mNextRecord += recordSize;
+        }
+        mRecord.clear();
+    }
+
+    if (mParseFailed && mHeaderEnd < 0) {
+        fprintf(stderr, "AppController: Could not parse the perf stream, clients connecting later may "
+                "not be able to read it\n");
+        mHeaderEnd = mNextRecord;
+    }
+}
+
+void PerfSpool::recordBoundary(qint64 offset, quint32 type)
+{
+    if (mHeaderEnd < 0) {
+        // The header also ends once it would not fit into the ring anymore
+        if (type != PERF_RECORD_SAMPLE && offset < mCapacity)
+            return;
+        mHeaderEnd = offset;
+    }
+    if (mBoundaries.isEmpty() || offset - mBoundaries.last() >= BoundaryInterval)
+        mBoundaries.append(offset);
+}
+
+void PerfSpool::store(const char *data, qint64 size)
+{
+    // The header is kept until its end is known
+    if (mHeaderEnd < 0 || mEnd < mHeaderEnd)
+        mHeader.append(data, mHeaderEnd < 0 ? size : qMin(size, mHeaderEnd - mEnd));
+    if (mHeaderEnd >= 0 && mHeader.size() > mHeaderEnd)
+        mHeader.truncate(mHeaderEnd);
+
+    // Only the last mCapacity bytes fit
+    if (size > mCapacity) {
+        data += size - mCapacity;
+        mEnd += size - mCapacity;
+        size = mCapacity;
+    }
+
+    while (size > 0) {
+        const qint64 index = mEnd % mCapacity;
+        const qint64 length = qMin(size, mCapacity - index);
+        if (mFileFd >= 0) {
+            if (pwrite(mFileFd, data, length, index) != length)
+                perror("Could not write perf spill file");
+        } else {
+            if (mBuffer.size() < index + length)
+                mBuffer.resize(index + length);
+            memcpy(mBuffer.data() + index, data, length);
+        }
+        data += length;
+        size -= length;
+        mEnd += length;
+    }
+    mBegin = qMax(mBegin, mEnd - mCapacity);
+    while (!mBoundaries.isEmpty() && mBoundaries.first() < mBegin)
+        mBoundaries.removeFirst();
+}
+qint64 PerfSpool::load(qint64 offset, char *data, qint64 size)
+{
+    const qint64 index = offset % mCapacity;
+    size = qMin(size, mCapacity - index);
+    if (mFileFd >= 0)
+        return pread(mFileFd, data, size, index);
+    memcpy(data, mBuffer.constData() + index, size);
+    return size;
+}
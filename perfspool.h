@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PERFSPOOL_H
+#define PERFSPOOL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QTcpSocket;
+class QSocketNotifier;
+
+// A client that lost its connection reconnects and sends PerfResumeMagic followed by the
+// number of bytes it has received, as big endian quint64. The controller answers with the
+// same magic and that offset and continues from there, or with PerfResumeRejected if the
+// spool no longer holds the data, in which case it closes the connection. Offsets count
+// the bytes sent since the last connection that did not resume.
+static const char PerfResumeMagic[] = "QPERFR1\n";
+static const int PerfResumeMagicSize = sizeof(PerfResumeMagic) - 1;
+static const quint64 PerfResumeRejected = ~quint64(0);
+
+// Keeps the perf stream in a bounded ring, in memory or in a file (e.g. on tmpfs), so
+// that recording continues while no client is connected and a reconnecting client can
+// resume where it left off. perf writes into inputFd().
+//
+// While a client is connected nothing is overwritten: the pipe is only read as fast as
+// the client receives, so that perf blocks or reports lost samples itself. Without a
+// client the oldest data is overwritten. Everything before the first sample (the stream
+// header, attributes, comm and mmap records) is kept aside, and a new client gets it
+// followed by the held data from the next record boundary on, so that it always receives
+// a stream perf can parse.
+class PerfSpool : public QObject
+{
+    Q_OBJECT
+public:
+    PerfSpool(qint64 capacity, const QString &fileName, QObject *parent = 0);
+    ~PerfSpool();
+
+    bool open();
+    int inputFd() const;
+
+    // Replaces the current client. offset < 0 starts a new stream with everything still
+    // held, otherwise the client gets the resume reply first and resumes from offset.
+    void setClient(QTcpSocket *socket, qint64 offset);
+
+    // Ends the input and waits up to timeout ms for a client to receive the rest
+    void finish(int timeout);
+
+signals:
+    void drained();
+
+private slots:
+    void readInput();
+    void writeToClient();
+    void clientDisconnected();
+
+private:
+    void store(const char *data, qint64 size);
+    qint64 load(qint64 offset, char *data, qint64 size);
+    void parse(const char *data, qint64 size);
+    void recordBoundary(qint64 offset, quint32 type);
+    qint64 sendOffset() const;
+    qint64 room() const;
+    bool isDrained() const;
+
+    qint64 mCapacity;
+    QString mFileName;
+    int mFileFd;
+    QByteArray mBuffer;
+    int mReadFd;
+    int mWriteFd;
+    QSocketNotifier *mInputNotifier;
+    QTcpSocket *mClient;
+    qint64 mBegin;    // oldest stream offset still held
+    qint64 mEnd;      // stream offset after the newest byte
+    qint64 mPosition; // next client offset to send
+    qint64 mGap;      // stream offset - client offset after the header
+    bool mInputClosed;
+
+    QByteArray mHeader;          // stream up to the first sample
+    qint64 mHeaderEnd;           // stream offset of the first sample, -1 until known
+    QList<qint64> mBoundaries;   // record offsets after the header, sparse and ascending
+    qint64 mNextRecord;          // stream offset of the next record
+    QByteArray mRecord;          // start of the next record, as far as received
+    bool mParseFailed;
+};
+
+#endif // PERFSPOOL_H
@@ -0,0 +1,242 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "portallocator.h"
+#include <QByteArray>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+static const int PortCount = 65536;
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+PortAllocator::PortAllocator(const Utils::PortList &range)
+    : mRange(range)
+    , mUsed(PortCount)
+    , mLeases(0)
+{
+    scan();
+}
+
+PortAllocator::~PortAllocator()
+{
+    foreach (int fd, mSockets)
+        close(fd);
+}
+
+void PortAllocator::setLeases(PortLeases *leases)
+{
+    mLeases = leases;
+}
+
+bool PortAllocator::allocate(int count, QVector<int> *ports)
+{
+    const bool leasing = mLeases && mLeases->lock();
+    if (leasing) {
+        Utils::PortList leased = mLeases->leased();
+        while (leased.hasMore()) {
+            const int port = leased.getNext();
+            if (port > 0 && port < PortCount)
+                mUsed.setBit(port);
+        }
+    }
+
+    QVector<int> allocated;
+    Utils::PortList range = mRange;
+    while (allocated.size() < count && range.hasMore()) {
+        const int port = range.getNext();
+        if (port <= 0 || port >= PortCount || mUsed.testBit(port))
+            continue;
+
+        // The scan may be stale, so a port is only ours once we listen on it
+        mUsed.setBit(port);
+        const int fd = openSocket(port, true);
+        if (fd < 0)
+            continue;
+        mSockets.insert(port, fd);
+        allocated.append(port);
+    }
+
+    if (allocated.size() < count) {
+        foreach (int port, allocated)
+            release(port);
+        if (leasing)
+            mLeases->unlock();
+        return false;
+    }
+
+    if (leasing) {
+        foreach (int port, allocated)
+            mLeases->add(port);
+        mLeases->unlock();
+    }
+
+    *ports += allocated;
+    return true;
+}
+
+int PortAllocator::allocate()
+{
+    QVector<int> ports;
+    if (!allocate(1, &ports))
+        return -1;
+    return ports.first();
+}
+
+int PortAllocator::takeSocket(int port, bool loopback)
+{
+    if (!mSockets.contains(port))
+        return -1;
+    if (!loopback)
+        return mSockets.take(port);
+    close(mSockets.take(port));
+    const int fd = openSocket(port, true, true);
+    if (fd < 0)
+        fprintf(stderr, "AppController: Could not bind port %d to localhost\n", port);
+    return fd;
+}
+
+int PortAllocator::takeReservation(int port)
+{
+    if (!mSockets.contains(port))
+        return -1;
+    // Closing a socket that never had a connection leaves nothing behind that blocks the bind
+    close(mSockets.take(port));
+    const int fd = openSocket(port, false);
+    if (fd < 0)
+        fprintf(stderr, "AppController: Could not keep port %d reserved\n", port);
+    return fd;
+}
+
+void PortAllocator::release(int port)
+{
+    if (mSockets.contains(port))
+        close(mSockets.take(port));
+}
+
+void PortAllocator::scan()
+{
+    scanFile("/proc/net/tcp");
+    scanFile("/proc/net/tcp6");
+}
+
+// Lines look like "  12: 0100007F:0CEA 00000000:0000 0A ...", where the hex number
+// after the colon of the local address is the port. Every state counts as used,
+// TIME_WAIT sockets would make a bind without SO_REUSEADDR fail as well.
+void PortAllocator::scanFile(const char *fileName)
+{
+    const int fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    QByteArray data;
+    char buffer[16384];
+    forever {
+        const ssize_t size = read(fd, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            break;
+        data.append(buffer, size);
+    }
+    close(fd);
+
+    const char *pos = data.constData();
+    const char *end = pos + data.size();
+
+    // Skip the header line
+    pos = static_cast<const char *>(memchr(pos, '\n', end - pos));
+    while (pos && pos < end) {
+        ++pos;
+        const char *lineEnd = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        if (!lineEnd)
+            lineEnd = end;
+
+        const char *colon = static_cast<const char *>(memchr(pos, ':', lineEnd - pos));
+        if (colon)
+            colon = static_cast<const char *>(memchr(colon + 1, ':', lineEnd - colon - 1));
+        if (colon) {
+            int port = 0;
+            const char *c = colon + 1;
+            for (; c < lineEnd && hexValue(*c) >= 0; ++c)
+                port = port * 16 + hexValue(*c);
+            if (c > colon + 1 && port < PortCount)
+                mUsed.setBit(port);
+        }
+
+        pos = lineEnd < end ? lineEnd : 0;
+    }
+}
+
+// Without SO_REUSEADDR a socket that only is bound still blocks every other bind to the port
+int PortAllocator::openSocket(int port, bool listening, bool loopback)
+{
+    const int enable = 1;
+    // Like QHostAddress::LocalHost, loopback sockets are IPv4 only
+    int fd = loopback ? -1 : socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        // Dual stack, like QTcpServer listening on QHostAddress::Any
+        const int disable = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+        if (listening)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+        struct sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0 && (!listening || listen(fd, 50) == 0))
+            return fd;
+        const int error = errno;
+        close(fd);
+        if (error != EADDRNOTAVAIL && error != EAFNOSUPPORT)
+            return -1;
+    }
+
+    // No IPv6 support, or loopback only
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (listening)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0 && (!listening || listen(fd, 50) == 0))
+        return fd;
+    close(fd);
+    return -1;
+}
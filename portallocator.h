@@ -0,0 +1,66 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PORTALLOCATOR_H
+#define PORTALLOCATOR_H
+
+#include "portlist.h"
+#include "portleases.h"
+#include <QBitArray>
+#include <QHash>
+#include <QVector>
+
+// Picks free TCP ports from a range without trial binds. The ports in use are read
+// once from /proc/net/tcp and /proc/net/tcp6 into a bitmap, and every allocated port
+// is held by a socket until it is handed over or released, so that no other process
+// can take it in between.
+class PortAllocator
+{
+public:
+    explicit PortAllocator(const Utils::PortList &range);
+    ~PortAllocator();
+
+    // Skips ports leased by other instances and leases the allocated ones
+    void setLeases(PortLeases *leases);
+
+    // Allocates count ports in a single pass over the range.
+    // Returns false if the range does not contain enough free ports.
+    bool allocate(int count, QVector<int> *ports);
+    int allocate();
+
+    // Transfers the listening socket of an allocated port to the caller. With loopback
+    // the port is bound to 127.0.0.1 instead of all interfaces.
+    int takeSocket(int port, bool loopback = false);
+    // Transfers an allocated port as a bound socket that does not listen, for ports that
+    // another process binds once the socket is closed. Until then connections are refused
+    // instead of being accepted into a backlog nobody serves and reset later.
+    int takeReservation(int port);
+    void release(int port);
+
+private:
+    void scan();
+    void scanFile(const char *fileName);
+    int openSocket(int port, bool listening, bool loopback = false);
+
+    Utils::PortList mRange;
+    QBitArray mUsed;
+    QHash<int, int> mSockets;
+    PortLeases *mLeases;
+};
+
+#endif // PORTALLOCATOR_H
@@ -0,0 +1,181 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "portleases.h"
+#include <QFile>
+#include <QList>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static bool isAlive(pid_t pid)
+{
+    return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+PortLeases::PortLeases(const QString &fileName)
+    : mFileName(QFile::encodeName(fileName))
+    , mFd(-1)
+    , mOwnLeases(false)
+{
+}
+
+PortLeases::~PortLeases()
+{
+    if (!mOwnLeases || !lock())
+        return;
+
+    const pid_t self = getpid();
+    for (int i = mLeases.size() - 1; i >= 0; --i) {
+        if (mLeases.at(i).pid == self)
+            mLeases.remove(i);
+    }
+    unlock();
+}
+
+bool PortLeases::lock()
+{
+    Q_ASSERT(mFd < 0);
+    // The file lives in a world-writable directory, a symlink placed there must not make us
+    // truncate some other file, and other users must not be able to inject leases
+    mFd = open(mFileName.constData(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if (mFd < 0) {
+        printf("AppController: Could not open port lease file %s: %s\n",
+               mFileName.constData(), strerror(errno));
+        return false;
+    }
+
+    int rc;
+    do {
+        rc = flock(mFd, LOCK_EX);
+    } while (rc != 0 && errno == EINTR);
+    if (rc != 0) {
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+
+    load();
+    return true;
+}
+
+void PortLeases::unlock()
+{
+    if (mFd < 0)
+        return;
+    save();
+    close(mFd); // releases the lock
+    mFd = -1;
+}
+
+Utils::PortList PortLeases::leased() const
+{
+    const pid_t self = getpid();
+    Utils::PortList ports;
+    foreach (const Lease &lease, mLeases) {
+        if (lease.pid != self)
+            ports.addPort(lease.port);
+    }
+    return ports;
+}
+
+void PortLeases::add(int port)
+{
+    Q_ASSERT(mFd >= 0);
+    Lease lease;
+    lease.pid = getpid();
+    lease.port = port;
+    mLeases.append(lease);
+    mOwnLeases = true;
+}
+
+bool PortLeases::adopt(pid_t owner)
+{
+    if (!mOwnLeases)
+        return true;
+    if (!lock())
+        return false;
+
+    const pid_t self = getpid();
+    for (int i = 0; i < mLeases.size(); ++i) {
+        if (mLeases.at(i).pid == owner)
+            mLeases[i].pid = self;
+    }
+    unlock();
+    return true;
+}
+
+void PortLeases::handOver()
+{
+    mOwnLeases = false;
+}
+
+void PortLeases::load()
+{
+    mLeases.clear();
+
+    QByteArray data;
+    char buffer[4096];
+    forever {
+        const ssize_t size = read(mFd, buffer, sizeof(buffer));
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            break;
+        data.append(buffer, size);
+    }
+
+    foreach (const QByteArray &line, data.split('\n')) {
+        const QList<QByteArray> fields = line.split(' ');
+        if (fields.size() != 2)
+            continue;
+        bool pidOk, portOk;
+        Lease lease;
+        lease.pid = fields.at(0).toInt(&pidOk);
+        lease.port = fields.at(1).toInt(&portOk);
+        if (pidOk && portOk && lease.pid > 0 && isAlive(lease.pid))
+            mLeases.append(lease);
+    }
+}
+
+void PortLeases::save()
+{
+    QByteArray data;
+    foreach (const Lease &lease, mLeases)
+        data += QByteArray::number(lease.pid) + ' ' + QByteArray::number(lease.port) + '\n';
+
+    if (ftruncate(mFd, 0) != 0 || lseek(mFd, 0, SEEK_SET) != 0)
+        return;
+    const char *pos = data.constData();
+    int remaining = data.size();
+    while (remaining > 0) {
+        const ssize_t written = write(mFd, pos, remaining);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("AppController: Could not write port lease file: %s\n", strerror(errno));
+            return;
+        }
+        pos += written;
+        remaining -= written;
+    }
+}
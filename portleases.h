@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PORTLEASES_H
+#define PORTLEASES_H
+
+#include "portlist.h"
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <sys/types.h>
+
+// Ports handed out by concurrently running appcontroller instances. The leases are
+// stored as "<pid> <port>" lines in a shared file guarded by flock(). Leases of
+// instances that are no longer alive are dropped whenever the file is read, and an
+// instance removes its own leases when it is destroyed.
+//
+// Usage: lock(), check leased(), add() the chosen ports, unlock().
+//
+// A process that forks to live on under another pid hands its leases over: the child
+// adopt()s them while the parent is still alive, then the parent calls handOver().
+class PortLeases
+{
+public:
+    explicit PortLeases(const QString &fileName);
+    ~PortLeases();
+
+    bool lock();
+    void unlock();
+
+    // Ports leased by other live instances, valid while locked
+    Utils::PortList leased() const;
+    void add(int port);
+
+    // Records the leases of owner under the current pid
+    bool adopt(pid_t owner);
+    // The leases are not removed on destruction, because a child adopted them
+    void handOver();
+
+private:
+    struct Lease {
+        pid_t pid;
+        int port;
+    };
+
+    void load();
+    void save();
+
+    QByteArray mFileName;
+    int mFd;
+    QVector<Lease> mLeases;
+    bool mOwnLeases;
+};
+
+#endif // PORTLEASES_H
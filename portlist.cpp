@@ -18,10 +18,11 @@
 
 #include "portlist.h"
 
-#include <QList>
+#include <QVector>
 #include <QPair>
 #include <QString>
 
+#include <algorithm>
 #include <cctype>
 
 namespace Utils {
@@ -135,12 +136,36 @@ private:
 
 } // anonymous namespace
 
+// The ranges are kept sorted, disjoint and non-adjacent. Ports are handed out by getNext()
+// in ascending order, ranges before head are used up.
 class PortListPrivate
 {
 public:
-    QList<Range> ranges;
+    PortListPrivate() : head(0), count(0) { }
+
+    void compact()
+    {
+        if (head > 0) {
+            ranges.remove(0, head);
+            head = 0;
+        }
+    }
+
+    QVector<Range> ranges;
+    int head;
+    int count;
 };
 
+static bool endsBefore(const Range &range, int port)
+{
+    return range.second < port;
+}
+
+static bool startsAfter(int port, const Range &range)
+{
+    return port < range.first;
+}
+
 } // namespace Internal
 
 PortList::PortList() : d(new Internal::PortListPrivate)
@@ -175,43 +200,58 @@ void PortList::addPort(int port) { addRange(port, port); }
 
 void PortList::addRange(int startPort, int endPort)
 {
-    d->ranges << Internal::Range(startPort, endPort);
+    d->compact();
+
+    // Merge with all ranges that overlap or touch the new one
+    QVector<Internal::Range>::iterator first = std::lower_bound(d->ranges.begin(), d->ranges.end(),
+                                                                startPort - 1, Internal::endsBefore);
+    QVector<Internal::Range>::iterator last = std::upper_bound(first, d->ranges.end(),
+                                                               endPort + 1, Internal::startsAfter);
+    Internal::Range merged(startPort, endPort);
+    for (QVector<Internal::Range>::iterator it = first; it != last; ++it) {
+        merged.first = qMin(merged.first, it->first);
+        merged.second = qMax(merged.second, it->second);
+        d->count -= it->second - it->first + 1;
+    }
+    d->count += merged.second - merged.first + 1;
+
+    const int index = first - d->ranges.begin();
+    d->ranges.erase(first, last);
+    d->ranges.insert(index, merged);
 }
 
-bool PortList::hasMore() const { return !d->ranges.isEmpty(); }
+bool PortList::hasMore() const { return d->head < d->ranges.size(); }
 
 bool PortList::contains(int port) const
 {
-    foreach (const Internal::Range &r, d->ranges) {
-        if (port >= r.first && port <= r.second)
-            return true;
-    }
-    return false;
+    QVector<Internal::Range>::const_iterator it = std::lower_bound(d->ranges.constBegin() + d->head,
+                                                                   d->ranges.constEnd(),
+                                                                   port, Internal::endsBefore);
+    return it != d->ranges.constEnd() && it->first <= port;
 }
 
 int PortList::count() const
 {
-    int n = 0;
-    foreach (const Internal::Range &r, d->ranges)
-        n += r.second - r.first + 1;
-    return n;
+    return d->count;
 }
 
 int PortList::getNext()
 {
-    Q_ASSERT(!d->ranges.isEmpty());
+    Q_ASSERT(hasMore());
 
-    Internal::Range &firstRange = d->ranges.first();
+    Internal::Range &firstRange = d->ranges[d->head];
     const int next = firstRange.first++;
     if (firstRange.first > firstRange.second)
-        d->ranges.removeFirst();
+        ++d->head;
+    --d->count;
     return next;
 }
 
 QString PortList::toString() const
 {
     QString stringRep;
-    foreach (const Internal::Range &range, d->ranges) {
+    for (int i = d->head; i < d->ranges.size(); ++i) {
+        const Internal::Range &range = d->ranges.at(i);
         stringRep += QString::number(range.first);
         if (range.second != range.first)
             stringRep += QLatin1Char('-') + QString::number(range.second);
@@ -17,6 +17,16 @@
 ****************************************************************************/
 
 #include "process.h"
+#include "controlprotocol.h"
+#include "processtree.h"
+#include "launchtrace.h"
+#include "interactiveenvironment.h"
+#include "signalnotifier.h"
+#include "framedoutput.h"
+#include "logserver.h"
+#include "resourcesampler.h"
+#include "perfeventsampler.h"
+#include "elfpreflight.h"
 #include <QCoreApplication>
 #include <unistd.h>
 #include <QDebug>
@@ -26,116 +36,174 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <QFileInfo>
+#include <QStandardPaths>
 #include <QTcpSocket>
 #include <errno.h>
 
-static int pipefd[2];
-
-static void signalhandler(int)
-{
-    write(pipefd[1], " ", 1);
-}
+#define ENVIRONMENT_CACHE_FILE "/data/user/.appcontroller-environment"
+#define DEFAULT_CGROUP_PARENT "/sys/fs/cgroup/appcontroller"
+#ifdef Q_OS_ANDROID
+#define ELF_CACHE_FILE "/data/user/.appcontroller-elfcache"
+#else
+#define ELF_CACHE_FILE "/tmp/.appcontroller-elfcache"
+#endif
 
-static bool analyzeBinary(const QString &binary)
+// Returns why the binary cannot be started, or 0 if it looks fine
+static const char *binaryProblem(const QString &binary)
 {
     QFileInfo fi(binary);
-    if (!fi.exists()) {
-        printf("Binary does not exist.\n");
-        return false;
-    }
-    if (!fi.isFile()) {
-        printf("Binary is not a file.\n");
-        return false;
-    }
-    if (!fi.isReadable()) {
-        printf("Binary is not readable.\n");
-        return false;
-    }
-    if (!fi.isExecutable()) {
-        printf("Binary is not executable.\n");
-        return false;
-    }
-
-    if (fi.size() < 4) {
-        printf("Binary is smaller than 4 bytes.\n");
-        return false;
-    }
+    if (!fi.exists())
+        return "Binary does not exist.";
+    if (!fi.isFile())
+        return "Binary is not a file.";
+    if (!fi.isReadable())
+        return "Binary is not readable.";
+    if (!fi.isExecutable())
+        return "Binary is not executable.";
+
+    if (fi.size() < 4)
+        return "Binary is smaller than 4 bytes.";
 
     QFile f(binary);
-    if (!f.open(QFile::ReadOnly)) {
-        printf("Could not open binary to analyze.\n");
-        return false;
-    }
+    if (!f.open(QFile::ReadOnly))
+        return "Could not open binary to analyze.";
 
     QByteArray elfHeader = f.read(4);
     f.close();
 
-    if (elfHeader.size() < 4) {
-        printf("Failed to read ELF header.\n");
-        return false;
+    if (elfHeader.size() < 4)
+        return "Failed to read ELF header.";
+
+    if (elfHeader != QByteArray::fromHex("7f454C46")) // 0x7f ELF
+        return "Binary is not an ELF file.";
+
+    return 0;
+}
+
+static bool analyzeBinary(const QString &binary)
+{
+    const char *problem = binaryProblem(binary);
+    if (problem)
+        printf("%s\n", problem);
+    return !problem;
+}
+
+// Redirects stdout and stderr of the child into the pipes owned by the OutputForwarder.
+class ChildProcess : public QProcess
+{
+public:
+    ChildProcess(Process *process)
+        : QProcess(process)
+        , mProcess(process)
+    {
     }
 
-    if (elfHeader != QByteArray::fromHex("7f454C46")) { // 0x7f ELF
-        printf("Binary is not an ELF file.\n");
-        return false;
+protected:
+    void setupChildProcess() Q_DECL_OVERRIDE
+    {
+        mProcess->setupChildProcess();
     }
 
-    return true;
+private:
+    Process *mProcess;
+};
+
+static bool waitForWritable(int fd)
+{
+    fd_set outputFdSet;
+    FD_ZERO(&outputFdSet);
+    FD_SET(fd, &outputFdSet);
+    fd_set inputFdSet;
+    FD_ZERO(&inputFdSet);
+    const int signalFd = SignalNotifier::instance()->fd();
+    FD_SET(signalFd, &inputFdSet);
+    return select(qMax(fd, signalFd) + 1, &inputFdSet, &outputFdSet, NULL, NULL) > 0 &&
+            !FD_ISSET(signalFd, &inputFdSet);
 }
 
 Process::Process()
     : QObject(0)
-    , mProcess(new QProcess(this))
+    , mProcess(new ChildProcess(this))
+    , mForwarder(new OutputForwarder(this))
+    , mPipeline(0)
+    , mFramedOutput(0)
+    , mLogServer(0)
+    , mSampler(0)
+    , mPerfSampler(0)
+    , mStdoutTimestamper("stdout")
+    , mStderrTimestamper("stderr")
+    , mSocketNotifier(0)
+    , mKilled(false)
+    , mStdoutSeen(false)
+    , mStderrSeen(false)
     , mDebuggee(0)
     , mDebug(false)
+    , mWaitForDebugger(false)
     , mStdoutFd(1)
+    , mStderrFd(2)
+    , mResident(false)
+    , mOutputFailed(false)
 {
-    mProcess->setProcessChannelMode(QProcess::SeparateChannels);
-    connect(mProcess, &QProcess::readyReadStandardError, this, &Process::readyReadStandardError);
-    connect(mProcess, &QProcess::readyReadStandardOutput, this, &Process::readyReadStandardOutput);
+    // The child writes into pipes owned by mForwarder, see setupChildProcess()
+    mProcess->setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(mForwarder, &OutputForwarder::readyReadStandardError, this, &Process::readyReadStandardError);
+    connect(mForwarder, &OutputForwarder::readyReadStandardOutput, this, &Process::readyReadStandardOutput);
+    connect(mProcess, &QProcess::started, this, &Process::started);
     connect(mProcess, (void (QProcess::*)(int, QProcess::ExitStatus))&QProcess::finished, this, &Process::finished);
     connect(mProcess, (void (QProcess::*)(QProcess::ProcessError))&QProcess::error, this, &Process::error);
     connect(mProcess, (void (QProcess::*)(int, QProcess::ExitStatus))&QProcess::finished, qApp, &QCoreApplication::quit);
 
-    if (pipe2(pipefd, O_CLOEXEC) != 0)
-        qWarning("Could not create pipe");
-
-    QSocketNotifier *n = new QSocketNotifier(pipefd[0], QSocketNotifier::Read, this);
-    connect(n, SIGNAL(activated(int)), this, SLOT(stop()));
+    connect(SignalNotifier::instance(), &SignalNotifier::received, this, &Process::stop);
 
-    signal(SIGINT, signalhandler);
-    signal(SIGTERM, signalhandler);
-    signal(SIGHUP, signalhandler);
-    signal(SIGPIPE, signalhandler);
+    mStopTimer.setSingleShot(true);
+    connect(&mStopTimer, &QTimer::timeout, this, &Process::stopTimeout);
 }
 
 Process::~Process()
 {
-    close(pipefd[0]);
-    close(pipefd[1]);
+    foreach (ControlClient *client, mControlClients.values())
+        closeControlClient(client);
+    releaseSocket();
+    releaseReservedSockets();
+}
+
+void Process::writeProcessOutput(OutputForwarder::Channel channel, const QByteArray &data)
+{
+    const bool isStdout = channel == OutputForwarder::StandardOutput;
+    const QByteArray &output = mConfig.timestamps != LineTimestamper::None && !data.isEmpty()
+            ? (isStdout ? mStdoutTimestamper : mStderrTimestamper).process(data.constData(), data.size())
+            : data;
+
+    if (mLogServer)
+        mLogServer->append(output.constData(), output.size());
+
+    if (mFramedOutput) {
+        mFramedOutput->append(isStdout ? FramedOutput::StandardOutput : FramedOutput::StandardError,
+                              output.constData(), output.size());
+        if (mConfig.flags.testFlag(Config::PrintDebugMessages))
+            qDebug() << output;
+        return;
+    }
+    forwardProcessOutput(isStdout ? mStdoutFd : mStderrFd, output);
 }
 
 void Process::forwardProcessOutput(qintptr fd, const QByteArray &data)
 {
+    if (mPipeline) {
+        mPipeline->write(fd, data.constData(), data.size());
+        if (mConfig.flags.testFlag(Config::PrintDebugMessages))
+            qDebug() << data;
+        return;
+    }
+
     const char *constData = data.constData();
     int size = data.size();
     while (size > 0) {
         int written = write(fd, constData, size);
         if (written == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                fd_set outputFdSet;
-                FD_ZERO(&outputFdSet);
-                FD_SET(fd, &outputFdSet);
-                fd_set inputFdSet;
-                FD_ZERO(&inputFdSet);
-                FD_SET(pipefd[0], &inputFdSet);
-                if (select(qMax(fd, pipefd[0]) + 1, &inputFdSet, &outputFdSet, NULL, NULL) > 0 &&
-                        !FD_ISSET(pipefd[0], &inputFdSet))
-                    continue;
-                // else fprintf below will output the appropriate errno
-            }
-            fprintf(stderr, "Cannot forward application output: %d - %s\n", errno, strerror(errno));
-            qApp->quit();
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitForWritable(fd))
+                continue;
+            outputFailed();
             break;
         }
         size -= written;
@@ -146,23 +214,99 @@ void Process::forwardProcessOutput(qintptr fd, const QByteArray &data)
         qDebug() << data;
 }
 
+void Process::spliceProcessOutput(OutputForwarder::Channel channel, qintptr fd)
+{
+    forever {
+        if (mForwarder->splice(channel, fd) >= 0)
+            return;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (waitForWritable(fd))
+                continue;
+        } else if (!mForwarder->canSplice(channel)) {
+            forwardProcessOutput(fd, mForwarder->read(channel));
+            return;
+        }
+        outputFailed();
+        return;
+    }
+}
+
+// The reader of the output went away, e.g. with EPIPE. A resident owner only loses this
+// application, so its remaining output is discarded until it has exited.
+void Process::outputFailed()
+{
+    fprintf(stderr, "Cannot forward application output: %d - %s\n", errno, strerror(errno));
+    mOutputFailed = true;
+    quit();
+}
+
+// Splicing is only possible as long as nothing needs to look at the data itself
+bool Process::canSpliceOutput(OutputForwarder::Channel channel) const
+{
+    if (mConfig.flags.testFlag(Config::PrintDebugMessages) || mPipeline || mFramedOutput
+            || mLogServer || mConfig.timestamps != LineTimestamper::None)
+        return false;
+    if (channel == OutputForwarder::StandardError && mDebug)
+        return false;
+    return mForwarder->canSplice(channel);
+}
+
+void Process::flushProcessOutput()
+{
+    // The application is gone, but its last output may still be sitting in the pipes
+    int available;
+    while ((available = mForwarder->bytesAvailable(OutputForwarder::StandardOutput)) > 0) {
+        readyReadStandardOutput();
+        if (mForwarder->bytesAvailable(OutputForwarder::StandardOutput) >= available)
+            break;
+    }
+    while ((available = mForwarder->bytesAvailable(OutputForwarder::StandardError)) > 0) {
+        readyReadStandardError();
+        if (mForwarder->bytesAvailable(OutputForwarder::StandardError) >= available)
+            break;
+    }
+}
 
 void Process::readyReadStandardOutput()
 {
-    forwardProcessOutput(mStdoutFd, mProcess->readAllStandardOutput());
+    if (!mStdoutSeen && mForwarder->bytesAvailable(OutputForwarder::StandardOutput) > 0) {
+        mStdoutSeen = true;
+        LaunchTrace::mark(LaunchTrace::FirstStdoutByte);
+        LaunchTrace::write();
+    }
+    if (mOutputFailed)
+        mForwarder->read(OutputForwarder::StandardOutput);
+    else if (canSpliceOutput(OutputForwarder::StandardOutput))
+        spliceProcessOutput(OutputForwarder::StandardOutput, mStdoutFd);
+    else
+        writeProcessOutput(OutputForwarder::StandardOutput, mForwarder->read(OutputForwarder::StandardOutput));
 }
 
 void Process::readyReadStandardError()
 {
-    QByteArray b = mProcess->readAllStandardError();
-    if (mDebug) {
+    if (!mStderrSeen && mForwarder->bytesAvailable(OutputForwarder::StandardError) > 0) {
+        mStderrSeen = true;
+        LaunchTrace::mark(LaunchTrace::FirstStderrByte);
+        LaunchTrace::write();
+    }
+    if (mOutputFailed) {
+        mForwarder->read(OutputForwarder::StandardError);
+        return;
+    }
+    if (canSpliceOutput(OutputForwarder::StandardError)) {
+        spliceProcessOutput(OutputForwarder::StandardError, mStderrFd);
+        return;
+    }
+
+    QByteArray b = mForwarder->read(OutputForwarder::StandardError);
+    if (mDebug && !b.isEmpty()) {
         int index = b.indexOf(" created; pid = ");
         if (index >= 0) {
             mDebuggee = QString::fromLatin1(b.mid(index+16)).toUInt();
         }
         mDebug = false; // only search once
     }
-    forwardProcessOutput(2, b);
+    writeProcessOutput(OutputForwarder::StandardError, b);
 }
 
 void Process::setDebug()
@@ -170,6 +314,11 @@ void Process::setDebug()
     mDebug = true;
 }
 
+void Process::setWaitForDebugger(bool wait)
+{
+    mWaitForDebugger = wait;
+}
+
 void Process::error(QProcess::ProcessError error)
 {
     switch (error) {
@@ -193,24 +342,56 @@ void Process::error(QProcess::ProcessError error)
         printf("Unknown error\n");
         break;
     }
-    qApp->quit();
+    if (error == QProcess::FailedToStart) {
+        mForwarder->close();
+        mCgroup.destroy();
+        mWarmup.release();
+        if (mPerfSampler)
+            mPerfSampler->finish();
+        emit exited(-1);
+    }
+    quit();
 }
 
 void Process::finished(int exitCode, QProcess::ExitStatus exitStatus)
 {
+    if (mStopTimer.isActive()) {
+        mStopTimer.stop();
+        printf("AppController: Application exited %lld ms after %s\n", mStopTime.elapsed(),
+               mKilled ? "SIGKILL" : "SIGTERM");
+    }
+    flushProcessOutput();
+    if (mSampler)
+        mSampler->stop();
+    if (mPerfSampler)
+        mPerfSampler->finish();
+    mCgroup.printReport();
+    mCgroup.destroy();
+    mWarmup.release();
+    if (mPipeline) {
+        mPipeline->finish();
+        mPipeline->printStatistics();
+    }
     if (exitStatus == QProcess::NormalExit)
         printf("Process exited with exit code %d\n", exitCode);
     else
         printf("Process stopped\n");
+    if (!mResident)
+        releaseSocket();
+    emit exited(exitStatus == QProcess::NormalExit ? exitCode : -1);
 }
 
-void Process::startup(QStringList args)
+QProcessEnvironment Process::processEnvironment()
 {
+    // A resident controller keeps the environment for all following launches
+    if (mEnvironment.isEmpty()) {
 #ifdef Q_OS_ANDROID
-    QProcessEnvironment pe = interactiveProcessEnvironment();
+        mEnvironment = interactiveProcessEnvironment();
 #else
-    QProcessEnvironment pe = QProcessEnvironment::systemEnvironment();
+        mEnvironment = QProcessEnvironment::systemEnvironment();
 #endif
+    }
+    QProcessEnvironment pe = mEnvironment;
 
     foreach (const QString &key, mConfig.env.keys()) {
         if (!pe.contains(key)) {
@@ -222,14 +403,130 @@ void Process::startup(QStringList args)
         pe.insert(QLatin1String("B2QT_BASE"), mConfig.base);
     if (!mConfig.platform.isEmpty())
         pe.insert(QLatin1String("B2QT_PLATFORM"), mConfig.platform);
+    return pe;
+}
 
+QString Process::applicationPath(const QProcessEnvironment &pe) const
+{
+    const QString binary = mApplicationBinary.isEmpty() ? mBinary : mApplicationBinary;
+    if (binary.contains(QLatin1Char('/')))
+        return binary;
+    return QStandardPaths::findExecutable(binary,
+            pe.value(QLatin1String("PATH")).split(QLatin1Char(':'), QString::SkipEmptyParts));
+}
+
+bool Process::preflight(const QProcessEnvironment &pe)
+{
+    mPreflight = ElfPreflight::Result();
+    mApplicationPath = applicationPath(pe);
+    // A binary that cannot be started at all is reported when starting it fails
+    if (mApplicationPath.isEmpty() || binaryProblem(mApplicationPath)) {
+        mApplicationPath.clear();
+        return true;
+    }
+
+    mPreflight = ElfPreflight::check(mApplicationPath,
+            pe.value(QLatin1String("LD_LIBRARY_PATH")).split(QLatin1Char(':'), QString::SkipEmptyParts),
+            QLatin1String(ELF_CACHE_FILE));
+    foreach (const QString &warning, mPreflight.warnings)
+        printf("AppController: %s\n", qPrintable(warning));
+    if (!mPreflight.isValid()) {
+        printf("AppController: %s\n", qPrintable(mPreflight.error));
+        return false;
+    }
+    return true;
+}
+
+bool Process::checkApplication()
+{
+    return preflight(processEnvironment());
+}
+
+void Process::startup(QStringList args)
+{
+    LaunchTrace::begin(LaunchTrace::Environment);
+    const QProcessEnvironment pe = processEnvironment();
     args.append(mConfig.args);
+    LaunchTrace::end(LaunchTrace::Environment);
 
     mProcess->setProcessEnvironment(pe);
     mBinary = args.first();
     args.removeFirst();
     qDebug() << mBinary << args;
+    mDebuggee = 0;
+    if (!preflight(pe)) {
+        emit exited(-1);
+        quit();
+        return;
+    }
+    if (!mForwarder->open()) {
+        printf("Could not set up output forwarding\n");
+        emit exited(-1);
+        quit();
+        return;
+    }
+    mStdoutSeen = mStderrSeen = false;
+    mOutputFailed = false;
+    mStdoutTimestamper.reset();
+    mStderrTimestamper.reset();
+    if (!mConfig.cgroupParent.isEmpty() || !mConfig.cgroupLimits.isEmpty()) {
+        const QString parent = mConfig.cgroupParent.isEmpty()
+                ? QLatin1String(DEFAULT_CGROUP_PARENT) : mConfig.cgroupParent;
+        if (!mCgroup.create(parent, mConfig.cgroupLimits))
+            printf("AppController: Starting the application without a cgroup\n");
+    }
+    if (mConfig.warmup != PageCacheWarmup::None) {
+        LaunchTrace::begin(LaunchTrace::Warmup);
+        mWarmup.run(mConfig.warmup, warmupFiles());
+        LaunchTrace::end(LaunchTrace::Warmup);
+    }
+
+    if (mPerfSampler && !mPerfSampler->prepare())
+        printf("AppController: Starting the application without the built-in sampler\n");
+
+    LaunchTrace::begin(LaunchTrace::ForkExec);
+    releaseReservedSockets();
     mProcess->start(mBinary, args);
+    if (mPerfSampler)
+        mPerfSampler->childForked();
+    mForwarder->childStarted();
+    if (mWaitForDebugger && mProcess->processId() > 0) {
+        // The pid is known from the fork, the host attaches to it and continues
+        printf("AppController: Application stopped with pid %lld, waiting for the debugger\n",
+               mProcess->processId());
+        fflush(stdout);
+    }
+}
+
+void Process::started()
+{
+    LaunchTrace::end(LaunchTrace::ForkExec);
+    if (mSampler)
+        mSampler->start(mProcess->processId());
+}
+
+void Process::setupChildProcess()
+{
+    // A resident controller must not be hit when the application's process group is killed
+    if (mResident)
+        setpgid(0, 0);
+    mCgroup.joinFromChild();
+    mConfig.launchPolicy.applyInChild();
+    mForwarder->setupChildProcess();
+    // Waits for the controller, so it comes last
+    if (mPerfSampler)
+        mPerfSampler->setupChild();
+    // Continued by the debugger, which then sees the exec of the application
+    if (mWaitForDebugger)
+        raise(SIGSTOP);
+}
+
+void Process::quit()
+{
+    if (!mResident)
+        qApp->quit();
+    else if (isRunning())
+        stop();
 }
 
 void Process::start(const QStringList &args)
@@ -241,6 +538,7 @@ void Process::stop()
 {
     if (mProcess->state() == QProcess::QProcess::NotRunning) {
         printf("No process running\n");
+        releaseSocket();
         qApp->exit();
         return;
     }
@@ -250,28 +548,162 @@ void Process::stop()
         if (kill(mDebuggee, SIGKILL) != 0)
             perror("Could not kill debugee");
     }
-    if (kill(-getpid(), SIGTERM) != 0)
+    if (mStopTimer.isActive())
+        return; // already stopping
+
+    const pid_t processGroup = mResident ? mProcess->processId() : getpid();
+    if (kill(-processGroup, SIGTERM) != 0)
         perror("Could not kill process group");
+    // An application still waiting for the debugger only gets the SIGTERM once continued
+    if (mWaitForDebugger)
+        kill(mProcess->processId(), SIGCONT);
 
     mProcess->terminate();
-    if (!mProcess->waitForFinished())
-        mProcess->kill();
+
+    // Keep the event loop running, so the application's last output is still forwarded
+    mKilled = false;
+    mStopTime.start();
+    mStopTimer.start(mConfig.terminateTimeout);
+}
+
+void Process::stopTimeout()
+{
+    if (!mKilled) {
+        // The cgroup also catches processes that were reparented away from the tree
+        mCgroup.kill();
+        const int count = ProcessTree::signalTree(mProcess->processId(), SIGKILL);
+        printf("AppController: Application did not exit %lld ms after SIGTERM, killed %d processes\n",
+               mStopTime.elapsed(), count);
+        mKilled = true;
+        mStopTime.start();
+        mStopTimer.start(mConfig.killTimeout);
+        return;
+    }
+
+    printf("AppController: Application did not exit %lld ms after SIGKILL\n", mStopTime.elapsed());
+    if (!mResident)
+        qApp->quit();
 }
 
 void Process::incomingConnection(int i)
 {
-    accept(i, NULL, NULL);
-    stop();
+    int fd = accept4(i, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        stop();
+        return;
+    }
+
+    ControlClient *client = new ControlClient;
+    client->fd = fd;
+    client->notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(client->notifier, &QSocketNotifier::activated, this, &Process::readControlCommand);
+    mControlClients.insert(fd, client);
+}
+
+void Process::readControlCommand(int fd)
+{
+    ControlClient *client = mControlClients.value(fd);
+    if (!client)
+        return;
+
+    switch (client->reader.readFrom(fd)) {
+    case CommandReader::Incomplete:
+        return;
+    case CommandReader::Error:
+        closeControlClient(client);
+        return;
+    case CommandReader::Closed:
+        // An older instance wants to take over
+        closeControlClient(client);
+        stop();
+        return;
+    case CommandReader::Complete:
+        break;
+    }
+
+    const QByteArray command = client->reader.command();
+    if (command == "PIDS") {
+        replyApplicationPids(fd);
+        closeControlClient(client);
+    } else if (command == "EXIT") {
+        // The new instance waits for "STOPPED" (or for the connection to close) before it binds
+        ControlProtocol::sendReply(fd, "STOPPING");
+        closeControlClient(client, false);
+        mTakeoverFds.append(fd);
+        stop();
+    } else {
+        ControlProtocol::sendReply(fd, "ERROR Unknown command " + command);
+        closeControlClient(client);
+    }
+}
+
+void Process::closeControlClient(ControlClient *client, bool closeFd)
+{
+    foreach (int fd, client->reader.takeFds())
+        close(fd);
+    mControlClients.remove(client->fd);
+    client->notifier->setEnabled(false);
+    client->notifier->deleteLater();
+    if (closeFd)
+        close(client->fd);
+    delete client;
+}
+
+void Process::replyApplicationPids(int fd) const
+{
+    if (!isRunning()) {
+        ControlProtocol::sendReply(fd, "ERROR No application running");
+        return;
+    }
+
+    // Under gdbserver only the debuggee and its children are of interest
+    const pid_t root = mDebuggee ? pid_t(mDebuggee) : pid_t(mProcess->processId());
+    QByteArray reply = "PIDS " + QByteArray::number(qint64(root));
+    foreach (pid_t pid, ProcessTree::descendants(root))
+        reply += ',' + QByteArray::number(qint64(pid));
+    ControlProtocol::sendReply(fd, reply);
 }
 
 void Process::setSocketNotifier(QSocketNotifier *s)
 {
+    mSocketNotifier = s;
     connect(s, &QSocketNotifier::activated, this, &Process::incomingConnection);
 }
 
+// Closes the control socket once the application is gone and tells waiting instances
+// that they can take over now.
+void Process::releaseSocket()
+{
+    if (mSocketNotifier) {
+        mSocketNotifier->setEnabled(false);
+        close(mSocketNotifier->socket());
+        mSocketNotifier = 0;
+    }
+    foreach (int fd, mTakeoverFds) {
+        ControlProtocol::sendReply(fd, "STOPPED");
+        close(fd);
+    }
+    mTakeoverFds.clear();
+}
+
 void Process::setConfig(const Config &config)
 {
     mConfig = config;
+    mStdoutTimestamper.setMode(mConfig.timestamps);
+    mStderrTimestamper.setMode(mConfig.timestamps);
+
+    delete mPipeline;
+    mPipeline = 0;
+    if (mConfig.outputBufferSize > 0) {
+        mPipeline = new OutputPipeline(mConfig.outputBufferSize, mConfig.outputPolicy, this);
+        mPipeline->setInterruptFd(SignalNotifier::instance()->fd());
+        connect(mPipeline, &OutputPipeline::writeFailed, this, &Process::quit);
+    }
+
+    delete mSampler;
+    mSampler = 0;
+    if (mConfig.resourceInterval > 0)
+        mSampler = new ResourceSampler(mConfig.resourceInterval, mConfig.resourceFile, this);
 }
 
 void Process::setStdoutFd(qintptr stdoutFd)
@@ -279,68 +711,81 @@ void Process::setStdoutFd(qintptr stdoutFd)
     mStdoutFd = stdoutFd;
 }
 
-QProcessEnvironment Process::interactiveProcessEnvironment() const
+void Process::setStderrFd(qintptr stderrFd)
 {
-    QProcessEnvironment env;
-
-    QProcess process;
-    process.start("sh");
-    if (!process.waitForStarted(3000)) {
-        printf("Could not start shell.\n");
-        return env;
-    }
-
-    process.write("source /system/etc/mkshrc\n");
-    process.write("export -p\n");
-    process.closeWriteChannel();
-
-    printf("waiting for process to finish\n");
-    if (!process.waitForFinished(1000)) {
-        printf("did not finish: terminate\n");
-        process.terminate();
-        if (!process.waitForFinished(1000)) {
-            printf("did not terminate: kill\n");
-            process.kill();
-            if (!process.waitForFinished(1000)) {
-                printf("Could not stop process.\n");
-            }
-        }
-    }
+    mStderrFd = stderrFd;
+}
 
-    QList<QByteArray> list = process.readAllStandardOutput().split('\n');
-    if (list.isEmpty())
-       printf("Failed to read environment output\n");
+void Process::setFramedOutput(FramedOutput *framedOutput)
+{
+    mFramedOutput = framedOutput;
+}
 
-    foreach (QByteArray entry, list) {
-        if (entry.startsWith("export ")) {
-            entry = entry.mid(7);
-        } else if (entry.startsWith("declare -x ")) {
-            entry = entry.mid(11);
-        } else {
-            continue;
-        }
+void Process::setLogServer(LogServer *logServer)
+{
+    mLogServer = logServer;
+}
 
-        QByteArray key;
-        QByteArray value;
-        int index = entry.indexOf('=');
+void Process::setApplicationBinary(const QString &binary)
+{
+    mApplicationBinary = binary;
+}
 
-        if (index > 0) {
-            key = entry.left(index);
-            value = entry.mid(index + 1);
-        } else {
-            key = entry;
-            // value is empty
-        }
+void Process::setPerfEventSampler(PerfEventSampler *sampler)
+{
+    mPerfSampler = sampler;
+}
+
+void Process::setReservedSockets(const QVector<int> &fds)
+{
+    mReservedSockets = fds;
+}
 
-        // Remove simple escaping.
-        // This is not complete.
-        if (value.startsWith('\'') and value.endsWith('\''))
-            value = value.mid(1, value.size()-2);
-        else if (value.startsWith('"') and value.endsWith('"'))
-            value = value.mid(1, value.size()-2);
+// The sockets are close-on-exec, so closing them here frees the ports for the child. The
+// ports stay unbound until gdbserver or the QML debugger in the child binds them after
+// its startup, connections in between are refused.
+void Process::releaseReservedSockets()
+{
+    foreach (int fd, mReservedSockets)
+        close(fd);
+    mReservedSockets.clear();
+}
 
-        env.insert(key, value);
+void Process::setResident(bool resident)
+{
+    mResident = resident;
+    if (mResident) {
+        // The owner decides what happens on exit and on signals
+        disconnect(mProcess, (void (QProcess::*)(int, QProcess::ExitStatus))&QProcess::finished, qApp, &QCoreApplication::quit);
+        disconnect(SignalNotifier::instance(), &SignalNotifier::received, this, &Process::stop);
     }
+}
 
-    return env;
+bool Process::isRunning() const
+{
+    return mProcess->state() != QProcess::NotRunning;
+}
+
+qint64 Process::processId() const
+{
+    return mProcess->processId();
+}
+
+QProcessEnvironment Process::interactiveProcessEnvironment() const
+{
+    return InteractiveEnvironment::load(QStringList() << QLatin1String("/system/etc/mkshrc"),
+                                        QLatin1String(ENVIRONMENT_CACHE_FILE));
+}
+
+QStringList Process::warmupFiles() const
+{
+    if (mApplicationPath.isEmpty())
+        return QStringList();
+
+    QStringList files;
+    files << mApplicationPath;
+    if (!mPreflight.dependencies.interpreter.isEmpty())
+        files << mPreflight.dependencies.interpreter;
+    files += mPreflight.dependencies.libraries;
+    return files;
 }
@@ -22,9 +22,25 @@
 #include <QObject>
 #include <QProcess>
 #include <QMap>
+#include <QVector>
 #include <QTcpServer>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "outputforwarder.h"
+#include "outputpipeline.h"
+#include "linetimestamper.h"
+#include "cgroup.h"
+#include "launchpolicy.h"
+#include "pagecachewarmup.h"
+#include "elfpreflight.h"
+#include "controlprotocol.h"
+#include <QHash>
 
 class QSocketNotifier;
+class FramedOutput;
+class LogServer;
+class ResourceSampler;
+class PerfEventSampler;
 
 struct Config {
     enum Flag {
@@ -37,7 +53,11 @@ struct Config {
         PublicDebugInterface
     };
 
-    Config() : flags(0) { }
+    Config()
+        : flags(0), terminateTimeout(30000), killTimeout(5000)
+        , outputBufferSize(0), outputPolicy(OutputPipeline::Block)
+        , timestamps(LineTimestamper::None), logBacklogSize(256 * 1024)
+        , resourceInterval(0), warmup(PageCacheWarmup::None) { }
 
     QString base;
     QString platform;
@@ -45,6 +65,18 @@ struct Config {
     QStringList args;
     Flags flags;
     DebugInterface debugInterface;
+    int terminateTimeout; // ms between SIGTERM and SIGKILL
+    int killTimeout;      // ms to wait after SIGKILL
+    int outputBufferSize; // bytes, 0 writes output directly from the event loop
+    OutputPipeline::Policy outputPolicy;
+    LineTimestamper::Mode timestamps;
+    int logBacklogSize;   // bytes of recent output kept for log server subscribers
+    int resourceInterval; // ms between resource samples, 0 disables sampling
+    QString resourceFile; // where samples are written, only a summary is printed if empty
+    QString cgroupParent; // cgroup v2 below which each launch gets its own group
+    QStringList cgroupLimits; // "<file>=<value>" written to the group of each launch
+    LaunchPolicy launchPolicy; // applied between fork and exec
+    PageCacheWarmup::Mode warmup; // page cache warmup of the binary and its libraries
 };
 
 class Process : public QObject
@@ -56,8 +88,24 @@ public:
     void start(const QStringList &args);
     void setSocketNotifier(QSocketNotifier*);
     void setDebug();
+    // Stops the application right before exec, so that a debugger can attach to it
+    void setWaitForDebugger(bool wait);
     void setConfig(const Config &);
     void setStdoutFd(qintptr stdoutFd);
+    void setStderrFd(qintptr stderrFd);
+    void setResident(bool resident);
+    void setReservedSockets(const QVector<int> &fds);
+    void setFramedOutput(FramedOutput *framedOutput);
+    void setLogServer(LogServer *logServer);
+    void setApplicationBinary(const QString &binary);
+    void setPerfEventSampler(PerfEventSampler *sampler);
+    bool checkApplication();
+    bool isRunning() const;
+    qint64 processId() const;
+    // Replies to PIDS with the processes of the application, see controlprotocol.h
+    void replyApplicationPids(int fd) const;
+signals:
+    void exited(int exitCode);
 public slots:
     void stop();
 private slots:
@@ -66,16 +114,67 @@ private slots:
     void finished(int, QProcess::ExitStatus);
     void error(QProcess::ProcessError);
     void incomingConnection(int);
+    void readControlCommand(int fd);
+    void started();
+    void stopTimeout();
+    void quit();
 private:
+    friend class ChildProcess;
+    struct ControlClient {
+        int fd;
+        QSocketNotifier *notifier;
+        CommandReader reader;
+    };
+
+    void setupChildProcess();
+    void closeControlClient(ControlClient *client, bool closeFd = true);
+    void writeProcessOutput(OutputForwarder::Channel channel, const QByteArray &data);
     void forwardProcessOutput(qintptr fd, const QByteArray &data);
+    void spliceProcessOutput(OutputForwarder::Channel channel, qintptr fd);
+    bool canSpliceOutput(OutputForwarder::Channel channel) const;
+    void flushProcessOutput();
+    void outputFailed();
+    void releaseSocket();
+    void releaseReservedSockets();
     void startup(QStringList);
     QProcessEnvironment interactiveProcessEnvironment() const;
+    QProcessEnvironment processEnvironment();
+    QString applicationPath(const QProcessEnvironment &pe) const;
+    bool preflight(const QProcessEnvironment &pe);
+    QStringList warmupFiles() const;
     QProcess *mProcess;
+    OutputForwarder *mForwarder;
+    OutputPipeline *mPipeline;
+    FramedOutput *mFramedOutput;
+    LogServer *mLogServer;
+    ResourceSampler *mSampler;
+    PerfEventSampler *mPerfSampler;
+    Cgroup mCgroup;
+    PageCacheWarmup mWarmup;
+    LineTimestamper mStdoutTimestamper;
+    LineTimestamper mStderrTimestamper;
+    QSocketNotifier *mSocketNotifier;
+    QList<int> mTakeoverFds;
+    QHash<int, ControlClient *> mControlClients;
+    QVector<int> mReservedSockets;
+    QTimer mStopTimer;
+    QElapsedTimer mStopTime;
+    bool mKilled;
+    bool mStdoutSeen;
+    bool mStderrSeen;
     int mDebuggee;
     bool mDebug;
+    bool mWaitForDebugger;
     Config mConfig;
     QString mBinary;
+    QString mApplicationBinary; // when started through gdbserver or perf
+    QString mApplicationPath;   // mApplicationBinary or mBinary found in PATH, if preflighted
+    ElfPreflight::Result mPreflight;
     qintptr mStdoutFd;
+    qintptr mStderrFd;
+    bool mResident;
+    bool mOutputFailed;
+    QProcessEnvironment mEnvironment;
 };
 
 #endif // PROCESS_H
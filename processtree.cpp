@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "processtree.h"
+#include <QHash>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static pid_t parentPid(pid_t pid)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    char buffer[512];
+    const ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (size <= 0)
+        return -1;
+    buffer[size] = 0;
+
+    // The command name may contain spaces and parentheses, the fields start after the last ')'
+    const char *fields = strrchr(buffer, ')');
+    if (!fields)
+        return -1;
+    // ") S ppid ..."
+    const char *ppid = strchr(fields + 2, ' ');
+    return ppid ? atoi(ppid + 1) : -1;
+}
+
+namespace ProcessTree {
+
+QList<pid_t> descendants(pid_t root)
+{
+    QList<pid_t> result;
+    DIR *dir = opendir("/proc");
+    if (!dir)
+        return result;
+
+    QMultiHash<pid_t, pid_t> children;
+    while (struct dirent *entry = readdir(dir)) {
+        char *end;
+        const pid_t pid = strtol(entry->d_name, &end, 10);
+        if (*end != 0 || pid <= 0)
+            continue;
+        const pid_t parent = parentPid(pid);
+        if (parent > 0)
+            children.insert(parent, pid);
+    }
+    closedir(dir);
+
+    QList<pid_t> queue;
+    queue.append(root);
+    while (!queue.isEmpty()) {
+        const pid_t pid = queue.takeFirst();
+        foreach (pid_t child, children.values(pid)) {
+            result.append(child);
+            queue.append(child);
+        }
+    }
+    return result;
+}
+
+int signalTree(pid_t root, int signal)
+{
+    // Collect first, so that nothing is reparented to init while we are still looking
+    const QList<pid_t> pids = descendants(root);
+    int count = 0;
+    if (kill(root, signal) == 0)
+        ++count;
+    foreach (pid_t pid, pids) {
+        if (kill(pid, signal) == 0)
+            ++count;
+    }
+    return count;
+}
+
+} // namespace ProcessTree
@@ -0,0 +1,35 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef PROCESSTREE_H
+#define PROCESSTREE_H
+
+#include <QList>
+#include <sys/types.h>
+
+namespace ProcessTree {
+
+// Returns all processes below root, found by following the parent pids in /proc.
+QList<pid_t> descendants(pid_t root);
+
+// Sends signal to root and all of its descendants. Returns the number of processes signalled.
+int signalTree(pid_t root, int signal);
+
+} // namespace ProcessTree
+
+#endif // PROCESSTREE_H
@@ -0,0 +1,312 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "resourcesampler.h"
+#include "processtree.h"
+#include <QFile>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int BufferSize = 8192;
+static const int RescanInterval = 1000; // ms
+
+static const char SampleHeader[] =
+        "# time_ms processes rss_kb pss_kb cpu_ms threads context_switches fds read_kb write_kb\n";
+
+static int openProcFile(pid_t pid, const char *name)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static quint64 fieldValue(const char *data, const char *name)
+{
+    const char *field = data ? strstr(data, name) : 0;
+    return field ? strtoull(field + strlen(name), 0, 10) : 0;
+}
+
+ResourceSampler::ResourceSampler(int interval, const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , mInterval(interval)
+    , mFileName(QFile::encodeName(fileName))
+    , mOutput(-1)
+    , mRoot(0)
+    , mBuffer(BufferSize, '\0')
+    , mLastRescan(0)
+    , mTicksPerSecond(sysconf(_SC_CLK_TCK))
+    , mPageSize(sysconf(_SC_PAGESIZE))
+    , mSamples(0)
+{
+    mTimer.setInterval(mInterval);
+    connect(&mTimer, &QTimer::timeout, this, &ResourceSampler::sample);
+}
+
+ResourceSampler::~ResourceSampler()
+{
+    stop();
+}
+
+void ResourceSampler::start(pid_t root)
+{
+    stop();
+
+    mRoot = root;
+    memset(&mExited, 0, sizeof(mExited));
+    memset(&mPeak, 0, sizeof(mPeak));
+    memset(&mSum, 0, sizeof(mSum));
+    memset(&mLast, 0, sizeof(mLast));
+    mSamples = 0;
+
+    if (!mFileName.isEmpty()) {
+        mOutput = open(mFileName.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (mOutput < 0)
+            perror("Could not open resource sample file");
+        else if (write(mOutput, SampleHeader, sizeof(SampleHeader) - 1) < 0)
+            perror("Could not write resource sample file");
+    }
+
+    mElapsed.start();
+    rescan();
+    sample();
+    mTimer.start();
+}
+
+void ResourceSampler::stop()
+{
+    if (!mRoot)
+        return;
+
+    mTimer.stop();
+    printSummary();
+
+    QHash<pid_t, ProcFiles *>::iterator it = mProcesses.begin();
+    for (; it != mProcesses.end(); ++it)
+        closeProcess(it.key(), it.value());
+    mProcesses.clear();
+    if (mOutput >= 0) {
+        close(mOutput);
+        mOutput = -1;
+    }
+    mRoot = 0;
+}
+
+void ResourceSampler::rescan()
+{
+    QList<pid_t> pids = ProcessTree::descendants(mRoot);
+    pids.prepend(mRoot);
+    foreach (pid_t pid, pids) {
+        if (!mProcesses.contains(pid)) {
+            if (ProcFiles *files = openProcess(pid))
+                mProcesses.insert(pid, files);
+        }
+    }
+    mLastRescan = mElapsed.elapsed();
+}
+
+ResourceSampler::ProcFiles *ResourceSampler::openProcess(pid_t pid)
+{
+    const int stat = openProcFile(pid, "stat");
+    if (stat < 0)
+        return 0;
+
+    ProcFiles *files = new ProcFiles;
+    memset(files, 0, sizeof(ProcFiles));
+    files->stat = stat;
+    files->statm = openProcFile(pid, "statm");
+    files->smapsRollup = openProcFile(pid, "smaps_rollup"); // Linux 4.14 and later
+    files->status = openProcFile(pid, "status");
+    files->io = openProcFile(pid, "io");                    // may need ptrace permission
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    files->fdDir = opendir(path);
+    return files;
+}
+
+void ResourceSampler::closeProcess(pid_t pid, ProcFiles *files)
+{
+    Q_UNUSED(pid);
+
+    // Keep the cumulative counters of processes that are gone
+    mExited.cpuTicks += files->cpuTicks;
+    mExited.contextSwitches += files->contextSwitches;
+    mExited.readBytes += files->readBytes;
+    mExited.writeBytes += files->writeBytes;
+
+    const int fds[] = { files->stat, files->statm, files->smapsRollup, files->status, files->io };
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+    if (files->fdDir)
+        closedir(files->fdDir);
+    delete files;
+}
+
+const char *ResourceSampler::readFile(int fd)
+{
+    if (fd < 0)
+        return 0;
+    const ssize_t size = pread(fd, mBuffer.data(), mBuffer.size() - 1, 0);
+    if (size <= 0)
+        return 0;
+    mBuffer[int(size)] = 0;
+    return mBuffer.constData();
+}
+
+bool ResourceSampler::readProcess(ProcFiles *files, Totals *totals)
+{
+    // The command name may contain spaces and parentheses, the fields start after the last ')'
+    const char *stat = readFile(files->stat);
+    const char *fields = stat ? strrchr(stat, ')') : 0;
+    if (!fields)
+        return false;
+
+    // Field 3 (state) follows the ')', utime and stime are fields 14 and 15, num_threads 20
+    char *pos = const_cast<char *>(fields + 2);
+    quint64 utime = 0, stime = 0, threads = 0;
+    for (int field = 3; field <= 20 && *pos; ++field) {
+        while (*pos == ' ')
+            ++pos;
+        char *end;
+        const quint64 value = strtoull(pos, &end, 10);
+        if (field == 14)
+            utime = value;
+        else if (field == 15)
+            stime = value;
+        else if (field == 20)
+            threads = value;
+        pos = strchr(pos, ' ');
+        if (!pos)
+            break;
+    }
+    files->cpuTicks = utime + stime;
+    totals->cpuTicks += files->cpuTicks;
+    totals->threads += threads;
+
+    if (const char *statm = readFile(files->statm)) {
+        // "size resident shared ..." in pages
+        const char *resident = strchr(statm, ' ');
+        if (resident)
+            totals->rss += strtoull(resident + 1, 0, 10) * mPageSize;
+    }
+
+    totals->pss += fieldValue(readFile(files->smapsRollup), "\nPss:") * 1024;
+
+    const char *status = readFile(files->status);
+    files->contextSwitches = fieldValue(status, "\nvoluntary_ctxt_switches:")
+            + fieldValue(status, "\nnonvoluntary_ctxt_switches:");
+    totals->contextSwitches += files->contextSwitches;
+
+    const char *io = readFile(files->io);
+    files->readBytes = fieldValue(io, "\nread_bytes:");
+    files->writeBytes = fieldValue(io, "\nwrite_bytes:");
+    totals->readBytes += files->readBytes;
+    totals->writeBytes += files->writeBytes;
+
+    if (files->fdDir) {
+        rewinddir(files->fdDir);
+        int count = 0;
+        while (struct dirent *entry = readdir(files->fdDir)) {
+            if (entry->d_name[0] != '.')
+                ++count;
+        }
+        totals->fds += count;
+    }
+    return true;
+}
+
+void ResourceSampler::sample()
+{
+    const qint64 now = mElapsed.elapsed();
+    if (now - mLastRescan >= RescanInterval)
+        rescan();
+
+    Totals totals;
+    memset(&totals, 0, sizeof(totals));
+    int processes = 0;
+    QHash<pid_t, ProcFiles *>::iterator it = mProcesses.begin();
+    while (it != mProcesses.end()) {
+        if (readProcess(it.value(), &totals)) {
+            ++processes;
+            ++it;
+        } else {
+            closeProcess(it.key(), it.value());
+            it = mProcesses.erase(it);
+        }
+    }
+    totals.cpuTicks += mExited.cpuTicks;
+    totals.contextSwitches += mExited.contextSwitches;
+    totals.readBytes += mExited.readBytes;
+    totals.writeBytes += mExited.writeBytes;
+
+    if (processes == 0)
+        return;
+
+    ++mSamples;
+    mLast = totals;
+    mPeak.rss = qMax(mPeak.rss, totals.rss);
+    mPeak.pss = qMax(mPeak.pss, totals.pss);
+    mPeak.threads = qMax(mPeak.threads, totals.threads);
+    mPeak.fds = qMax(mPeak.fds, totals.fds);
+    mSum.rss += totals.rss;
+    mSum.pss += totals.pss;
+    mSum.threads += totals.threads;
+    mSum.fds += totals.fds;
+
+    if (mOutput >= 0) {
+        char line[256];
+        const int size = snprintf(line, sizeof(line), "%lld %d %llu %llu %llu %llu %llu %llu %llu %llu\n",
+                                  now, processes, totals.rss / 1024, totals.pss / 1024,
+                                  totals.cpuTicks * 1000 / mTicksPerSecond, totals.threads,
+                                  totals.contextSwitches, totals.fds,
+                                  totals.readBytes / 1024, totals.writeBytes / 1024);
+        if (write(mOutput, line, qMin(size, int(sizeof(line)) - 1)) < 0) {
+            perror("Could not write resource sample file");
+            close(mOutput);
+            mOutput = -1;
+        }
+    }
+}
+
+void ResourceSampler::printSummary() const
+{
+    if (mSamples == 0)
+        return;
+
+    const qint64 elapsed = mElapsed.elapsed();
+    const quint64 cpuMs = mLast.cpuTicks * 1000 / mTicksPerSecond;
+    printf("AppController: Resources over %d samples in %lld ms:\n"
+           "  RSS peak %llu kB, average %llu kB\n"
+           "  PSS peak %llu kB, average %llu kB\n"
+           "  threads peak %llu, average %llu\n"
+           "  fds peak %llu, average %llu\n"
+           "  CPU time %llu ms (%.1f%% of one core), context switches %llu\n"
+           "  I/O read %llu kB, written %llu kB\n",
+           mSamples, elapsed,
+           mPeak.rss / 1024, mSum.rss / mSamples / 1024,
+           mPeak.pss / 1024, mSum.pss / mSamples / 1024,
+           mPeak.threads, mSum.threads / mSamples,
+           mPeak.fds, mSum.fds / mSamples,
+           cpuMs, elapsed > 0 ? 100.0 * cpuMs / elapsed : 0.0, mLast.contextSwitches,
+           mLast.readBytes / 1024, mLast.writeBytes / 1024);
+}
@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef RESOURCESAMPLER_H
+#define RESOURCESAMPLER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <sys/types.h>
+#include <dirent.h>
+
+// Samples the resource usage of the application and its descendants from /proc at a
+// fixed interval. The /proc files of every process are opened once and re-read with
+// pread() into a preallocated buffer. The process tree itself is only rescanned once
+// a second, as that needs a walk over all of /proc.
+//
+// Each sample is summed over the tree and, if a file name was given, written as one
+// line of space-separated numbers, see the header line of the file. A summary with
+// peak and average values is printed when sampling stops.
+class ResourceSampler : public QObject
+{
+    Q_OBJECT
+public:
+    ResourceSampler(int interval, const QString &fileName, QObject *parent = 0);
+    ~ResourceSampler();
+
+    void start(pid_t root);
+    void stop();
+
+private slots:
+    void sample();
+
+private:
+    struct ProcFiles {
+        int stat;
+        int statm;
+        int smapsRollup;
+        int status;
+        int io;
+        DIR *fdDir;
+        // Last values seen, still counted once the process is gone
+        quint64 cpuTicks;
+        quint64 contextSwitches;
+        quint64 readBytes;
+        quint64 writeBytes;
+    };
+
+    struct Totals {
+        quint64 rss;      // bytes
+        quint64 pss;      // bytes
+        quint64 cpuTicks;
+        quint64 threads;
+        quint64 contextSwitches;
+        quint64 fds;
+        quint64 readBytes;
+        quint64 writeBytes;
+    };
+
+    void rescan();
+    ProcFiles *openProcess(pid_t pid);
+    void closeProcess(pid_t pid, ProcFiles *files);
+    bool readProcess(ProcFiles *files, Totals *totals);
+    const char *readFile(int fd);
+    void printSummary() const;
+
+    const int mInterval;
+    const QByteArray mFileName;
+    int mOutput;
+    QTimer mTimer;
+    QElapsedTimer mElapsed;
+    pid_t mRoot;
+    QHash<pid_t, ProcFiles *> mProcesses;
+    QByteArray mBuffer;
+    qint64 mLastRescan;
+    long mTicksPerSecond;
+    long mPageSize;
+
+    Totals mExited;
+    Totals mPeak;
+    Totals mSum;
+    Totals mLast;
+    int mSamples;
+};
+
+#endif // RESOURCESAMPLER_H
@@ -0,0 +1,83 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#include "signalnotifier.h"
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+static int pipefd[2] = { -1, -1 };
+
+static void signalhandler(int)
+{
+    // A full pipe already wakes up the notifier
+    if (write(pipefd[1], " ", 1) < 0) { }
+}
+
+SignalNotifier *SignalNotifier::instance()
+{
+    static SignalNotifier *notifier = 0;
+    if (!notifier)
+        notifier = new SignalNotifier;
+    return notifier;
+}
+
+SignalNotifier::SignalNotifier()
+    : QObject(qApp)
+{
+    if (pipe2(pipefd, O_CLOEXEC) != 0)
+        qWarning("Could not create pipe");
+
+    QSocketNotifier *n = new QSocketNotifier(pipefd[0], QSocketNotifier::Read, this);
+    connect(n, &QSocketNotifier::activated, this, &SignalNotifier::readPipe);
+
+    signal(SIGINT, signalhandler);
+    signal(SIGTERM, signalhandler);
+    signal(SIGHUP, signalhandler);
+    signal(SIGPIPE, signalhandler);
+}
+
+SignalNotifier::~SignalNotifier()
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGHUP, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    pipefd[0] = pipefd[1] = -1;
+}
+
+int SignalNotifier::fd() const
+{
+    return pipefd[0];
+}
+
+void SignalNotifier::ignoreBrokenPipe()
+{
+    signal(SIGPIPE, SIG_IGN);
+}
+
+void SignalNotifier::readPipe()
+{
+    char buffer[16];
+    read(pipefd[0], buffer, sizeof(buffer));
+    emit received();
+}
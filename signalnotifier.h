@@ -0,0 +1,50 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+#ifndef SIGNALNOTIFIER_H
+#define SIGNALNOTIFIER_H
+
+#include <QObject>
+
+// Turns SIGINT, SIGTERM, SIGHUP and SIGPIPE into the received() signal through a
+// self-pipe. There is only one handler per signal, so all Process instances share it.
+class SignalNotifier : public QObject
+{
+    Q_OBJECT
+public:
+    static SignalNotifier *instance();
+
+    // Becomes readable when a signal arrived, for code that blocks outside the event loop
+    int fd() const;
+
+    // SIGPIPE only means that one reader of application output went away. Owners of several
+    // applications ignore it and handle EPIPE for the affected application instead.
+    void ignoreBrokenPipe();
+
+signals:
+    void received();
+
+private slots:
+    void readPipe();
+
+private:
+    SignalNotifier();
+    ~SignalNotifier();
+};
+
+#endif // SIGNALNOTIFIER_H
@@ -0,0 +1,14 @@
+QT-=gui
+QT+=testlib
+CONFIG+=console testcase no_testcase_installs
+CONFIG-=app_bundle
+
+TARGET=tst_interactiveenvironment
+INCLUDEPATH+=..
+
+HEADERS=\
+        ../interactiveenvironment.h
+
+SOURCES=\
+        tst_interactiveenvironment.cpp \
+        ../interactiveenvironment.cpp
@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd
+** All rights reserved.
+** For any questions to The Qt Company, please use contact form at http://www.qt.io/contact-us
+**
+** This file is part of QtEnterprise Embedded.
+**
+** Licensees holding valid Qt Enterprise licenses may use this file in
+** accordance with the Qt Enterprise License Agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company.
+**
+** If you have questions regarding the use of this file, please use
+** contact form at http://www.qt.io/contact-us
+**
+****************************************************************************/
+
+
+#include "interactiveenvironment.h"
+#include <QtTest>
+
+class tst_InteractiveEnvironment : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void parseExports_data();
+    void parseExports();
+    void parseExportsSeveral();
+};
+
+void tst_InteractiveEnvironment::parseExports_data()
+{
+    QTest::addColumn<QByteArray>("output");
+    QTest::addColumn<QString>("key");
+    QTest::addColumn<QString>("value");
+
+    QTest::newRow("plain") << QByteArray("export FOO=bar\n") << "FOO" << "bar";
+    QTest::newRow("no trailing newline") << QByteArray("export FOO=bar") << "FOO" << "bar";
+    QTest::newRow("single quotes") << QByteArray("export FOO='a b'\n") << "FOO" << "a b";
+    QTest::newRow("mksh quote escape") << QByteArray("export FOO='it'\\''s'\n") << "FOO" << "it's";
+    QTest::newRow("double quotes") << QByteArray("declare -x FOO=\"a \\\"b\\\" \\$c \\\\ d\"\n")
+                                   << "FOO" << "a \"b\" $c \\ d";
+    QTest::newRow("double quotes keep other backslashes")
+            << QByteArray("declare -x FOO=\"a\\tb\"\n") << "FOO" << "a\\tb";
+    QTest::newRow("ansi-c escapes") << QByteArray("export FOO=$'a\\tb\\nc\\x41\\101\\''\n")
+                                    << "FOO" << "a\tb\ncAA'";
+    QTest::newRow("backslash outside quotes") << QByteArray("export FOO=a\\ b\n") << "FOO" << "a b";
+    QTest::newRow("newline in single quotes") << QByteArray("export FOO='one\ntwo'\nexport BAR=x\n")
+                                              << "FOO" << "one\ntwo";
+    QTest::newRow("newline in double quotes") << QByteArray("declare -x FOO=\"one\ntwo\"\n")
+                                              << "FOO" << "one\ntwo";
+    QTest::newRow("line after multi-line value") << QByteArray("export FOO='one\ntwo'\nexport BAR=x\n")
+                                                 << "BAR" << "x";
+    QTest::newRow("empty quoted") << QByteArray("export FOO=''\n") << "FOO" << "";
+    QTest::newRow("empty double quoted") << QByteArray("declare -x FOO=\"\"\n") << "FOO" << "";
+    QTest::newRow("empty unquoted") << QByteArray("export FOO=\n") << "FOO" << "";
+    QTest::newRow("without value") << QByteArray("declare -x FOO\n") << "FOO" << "";
+    QTest::newRow("other lines ignored") << QByteArray("FOO=wrong\nexport FOO=right\n") << "FOO" << "right";
+}
+
+void tst_InteractiveEnvironment::parseExports()
+{
+    QFETCH(QByteArray, output);
+    QFETCH(QString, key);
+    QFETCH(QString, value);
+
+    const QProcessEnvironment env = InteractiveEnvironment::parseExports(output);
+    QVERIFY(env.contains(key));
+    QCOMPARE(env.value(key), value);
+}
+
+void tst_InteractiveEnvironment::parseExportsSeveral()
+{
+    const QProcessEnvironment env = InteractiveEnvironment::parseExports(
+                "export A=1\n"
+                "export B='two\nlines'\n"
+                "garbage\n"
+                "export C=\n");
+    QCOMPARE(env.keys().size(), 3);
+    QCOMPARE(env.value(QLatin1String("A")), QString::fromLatin1("1"));
+    QCOMPARE(env.value(QLatin1String("B")), QString::fromLatin1("two\nlines"));
+    QCOMPARE(env.value(QLatin1String("C")), QString());
+}
+
+QTEST_GUILESS_MAIN(tst_InteractiveEnvironment)
+
+#include "tst_interactiveenvironment.moc"